@@ -0,0 +1,151 @@
+/*
+ * NHVE Network Hardware Video Encoder library benchmark of
+ * stream encryption overhead (library built with NHVE_ENCRYPTION)
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include <stdio.h> //printf, fprintf
+#include <stdlib.h> //atoi, malloc
+#include <string.h> //memcpy, memcmp
+#include <inttypes.h> //uint8_t
+#include <time.h> //clock_gettime
+
+#include "../nhve_crypto.h"
+
+int MEGABYTES=1024; //data encrypted per cipher and frame size
+const int RING_MEGABYTES=64; //encrypted frames kept for decryption (receiver rejects replayed frames)
+
+//typical frame sizes, from small auxiliary data through H.264 P frames to large keyframes
+const int FRAME_SIZES[]={1400, 16*1024, 128*1024, 1024*1024};
+const int FRAME_SIZES_COUNT=sizeof(FRAME_SIZES)/sizeof(FRAME_SIZES[0]);
+
+int benchmark(const char *name, int cipher, const uint8_t *key);
+int process_user_input(int argc, char* argv[]);
+double time_s();
+
+int main(int argc, char* argv[])
+{
+	if( process_user_input(argc, argv) < 0 )
+		return -1;
+
+	uint8_t key[NHVE_CRYPTO_KEY_SIZE];
+
+	//fixed key is fine for benchmark, use random pre-shared key in practice
+	for(int i=0;i<NHVE_CRYPTO_KEY_SIZE;++i)
+		key[i] = i;
+
+	printf("%-18s %10s %12s %12s %14s\n", "cipher", "frame size", "encrypt GB/s", "decrypt GB/s", "encrypt ms/Gbit");
+
+	if(benchmark("copy (baseline)", NHVE_CRYPTO_NONE, key) != 0 ||
+	   benchmark("aes-256-gcm", NHVE_CRYPTO_AES_256_GCM, key) != 0 ||
+	   benchmark("chacha20-poly1305", NHVE_CRYPTO_CHACHA20_POLY1305, key) != 0)
+		return -1;
+
+	printf("\nms/Gbit is single core CPU time needed to encrypt 1 Gbit of stream\n");
+
+	return 0;
+}
+
+//NHVE_CRYPTO_NONE measures plain copy to separate buffer for comparison
+//frames are encrypted to ring of buffers and then decrypted, each frame is decrypted once
+int benchmark(const char *name, int cipher, const uint8_t *key)
+{
+	const int max_size = FRAME_SIZES[FRAME_SIZES_COUNT-1];
+	const int ring_bytes = RING_MEGABYTES * 1024 * 1024;
+	uint8_t *data = (uint8_t*)malloc(max_size);
+	uint8_t *encrypted = (uint8_t*)malloc(ring_bytes + (ring_bytes / FRAME_SIZES[0] + 1) * NHVE_CRYPTO_OVERHEAD);
+	uint8_t *decrypted = (uint8_t*)malloc(max_size);
+	struct nhve_crypto *encryptor = NULL, *decryptor = NULL;
+	int status = 0;
+
+	if(data == NULL || encrypted == NULL || decrypted == NULL)
+		status = -1;
+	else if(cipher != NHVE_CRYPTO_NONE &&
+	        ((encryptor = nhve_crypto_init(cipher, key)) == NULL || (decryptor = nhve_crypto_init(cipher, key)) == NULL))
+		status = -1;
+	else
+		for(int i=0;i<max_size;++i)
+			data[i] = i * 7;
+
+	for(int s=0;s<FRAME_SIZES_COUNT && !status;++s)
+	{
+		const int size = FRAME_SIZES[s];
+		const int encrypted_size = encryptor ? size + NHVE_CRYPTO_OVERHEAD : size;
+		const int ring = ring_bytes / size > 0 ? ring_bytes / size : 1;
+		const int frames = (int)((uint64_t)MEGABYTES * 1024 * 1024 / size);
+		double start, encrypt_s = 0, decrypt_s = 0;
+
+		for(int f=0;f<frames && !status;f+=ring)
+		{
+			const int batch = frames - f < ring ? frames - f : ring;
+
+			start = time_s();
+
+			for(int b=0;b<batch && !status;++b)
+				if(encryptor)
+					status = nhve_crypto_encrypt(encryptor, data, size, encrypted + b * encrypted_size, 0) != encrypted_size;
+				else
+					memcpy(encrypted + b * encrypted_size, data, size);
+
+			encrypt_s += time_s() - start;
+			start = time_s();
+
+			for(int b=0;b<batch && !status;++b)
+				if(decryptor)
+					status = nhve_crypto_decrypt(decryptor, encrypted + b * encrypted_size, encrypted_size, decrypted, 0) != size;
+				else
+					memcpy(decrypted, encrypted + b * encrypted_size, size);
+
+			decrypt_s += time_s() - start;
+		}
+
+		if(!status && memcmp(data, decrypted, size))
+			status = -1;
+
+		if(status)
+		{
+			fprintf(stderr, "%s failed for frame size %d\n", name, size);
+			break;
+		}
+
+		const double bytes = (double)frames * size;
+
+		printf("%-18s %10d %12.2f %12.2f %14.1f\n", name, size,
+		       bytes / encrypt_s / 1e9, bytes / decrypt_s / 1e9, encrypt_s * 1000 / (bytes * 8 / 1e9));
+	}
+
+	nhve_crypto_close(encryptor);
+	nhve_crypto_close(decryptor);
+	free(data);
+	free(encrypted);
+	free(decrypted);
+
+	return status;
+}
+
+int process_user_input(int argc, char* argv[])
+{
+	if(argc > 1 && (MEGABYTES = atoi(argv[1])) <= 0)
+	{
+		fprintf(stderr, "Usage: %s [megabytes]\n", argv[0]);
+		fprintf(stderr, "\nexamples:\n");
+		fprintf(stderr, "%s\n", argv[0]);
+		fprintf(stderr, "%s 4096\n", argv[0]);
+		return -1;
+	}
+
+	return 0;
+}
+
+double time_s()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
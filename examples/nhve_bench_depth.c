@@ -0,0 +1,310 @@
+/*
+ * NHVE Network Hardware Video Encoder library benchmark of
+ * depth streaming as raw auxiliary data, RVL compressed auxiliary data and HEVC Main10 video
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include <stdio.h> //printf, fprintf, fopen, fread
+#include <stdlib.h> //atoi, malloc, rand
+#include <string.h> //strcmp, memcmp
+#include <inttypes.h> //uint8_t
+#include <time.h> //clock_gettime
+
+#include "../nhve.h"
+#include "../nhve_rvl.h"
+
+const char *IP; //e.g "127.0.0.1"
+unsigned short PORT; //e.g. 9667
+const char *DEPTH_FILE; //recorded raw Z16 frames (WIDTH*HEIGHT*2 bytes each) or "-" for synthetic
+
+const int WIDTH=848; //e.g. Realsense D400 depth
+const int HEIGHT=480;
+const int FRAMERATE=30;
+const int FRAMES=300; //benchmarked frames, recording is looped if shorter
+const char *DEVICE; //NULL for default or device e.g. "/dev/dri/renderD128"
+const char *ENCODER="hevc_vaapi";//NULL for default (h264_vaapi) or FFmpeg encoder e.g. "hevc_vaapi", ...
+const char *PIXEL_FORMAT="p010le"; //depth is passed as p010le luminance, like in realsense-network-hardware-video-encoder
+const int PROFILE=FF_PROFILE_HEVC_MAIN_10; //or FF_PROFILE_HEVC_MAIN, ...
+const int BFRAMES=0; //max_b_frames, set to 0 to minimize latency, non-zero to minimize size
+const int BITRATE=8000000; //average bitrate in VBR mode (bit_rate != 0 and qp == 0)
+const int QP=0; //quantization parameter in CQP mode (qp != 0 and bit_rate == 0)
+const int GOP_SIZE=0; //group of pictures size, 0 for default (determines keyframe period)
+const int COMPRESSION_LEVEL=0; //speed-quality tradeoff, 0 for default, 1 for the highest quality, 7 for the fastest
+const int LOW_POWER=0; //alternative limited low-power encoding path if non-zero
+
+//channels (subframes) compared in benchmark
+enum {HEVC_CHANNEL=0, RAW_CHANNEL=1, RVL_CHANNEL=2};
+
+//IP, PORT, DEPTH_FILE and DEVICE are read from user input
+
+int benchmark_loop(struct nhve *streamer, uint16_t *depth, int frames);
+int benchmark_rvl(uint16_t *depth, int frames);
+void print_channel_stats(struct nhve *streamer, const char *name, uint8_t subframe, double seconds);
+int load_depth(uint16_t **depth);
+void synthetic_depth(uint16_t *depth, int f);
+int process_user_input(int argc, char* argv[]);
+int hint_user_on_failure(char *argv[]);
+double time_s();
+
+int main(int argc, char* argv[])
+{
+	//get DEPTH_FILE and DEVICE from the command line
+	if( process_user_input(argc, argv) < 0 )
+		return -1;
+
+	uint16_t *depth;
+	int frames;
+
+	if( (frames = load_depth(&depth)) <= 0 )
+		return -1;
+
+	//prepare library data
+	struct nhve_net_config net_config = {IP, PORT};
+	struct nhve_hw_config hw_config = {WIDTH, HEIGHT, FRAMERATE, DEVICE, ENCODER,
+                                           PIXEL_FORMAT, PROFILE, BFRAMES, BITRATE,
+	                                   QP, GOP_SIZE, COMPRESSION_LEVEL, LOW_POWER};
+	struct nhve *streamer;
+
+	//single hardware encoder and two auxiliary channels
+	if( (streamer = nhve_init(&net_config, &hw_config, 1, 2)) == NULL )
+	{
+		free(depth);
+		return hint_user_on_failure(argv);
+	}
+
+	//the first auxiliary channel is sent raw (default), the second is RVL compressed
+	int status = nhve_set_auxiliary_codec(streamer, RVL_CHANNEL, NHVE_AUX_RVL);
+
+	if(status == NHVE_OK)
+		status = benchmark_loop(streamer, depth, frames);
+
+	nhve_close(streamer);
+
+	if(status == 0)
+		status = benchmark_rvl(depth, frames);
+
+	free(depth);
+
+	return status;
+}
+
+int benchmark_loop(struct nhve *streamer, uint16_t *depth, int frames)
+{
+	struct nhve_frame frame = { 0 };
+	double seconds[3] = {0};
+	int f;
+
+	uint16_t *color = (uint16_t*)malloc(WIDTH*HEIGHT/2 * sizeof(uint16_t)); //p010le color data
+
+	if(color == NULL)
+		return -1;
+
+	for(int i=0;i<WIDTH*HEIGHT/2;++i)
+		color[i] = UINT16_MAX / 2; //middle value for U/V, no color in depth
+
+	for(f=0;f<FRAMES;++f)
+	{
+		uint16_t *d = depth + (size_t)(f % frames) * WIDTH * HEIGHT;
+		double start;
+
+		//depth as HEVC Main10 video (lossy)
+		frame.data[0] = (uint8_t*)d;
+		frame.data[1] = (uint8_t*)color;
+		frame.linesize[0] = frame.linesize[1] = WIDTH*2;
+
+		start = time_s();
+		if(nhve_send(streamer, &frame, HEVC_CHANNEL) != NHVE_OK)
+			break;
+		seconds[HEVC_CHANNEL] += time_s() - start;
+
+		//depth as raw auxiliary data, size in linesize[0]
+		frame.data[1] = NULL;
+		frame.linesize[0] = WIDTH*HEIGHT*2;
+
+		start = time_s();
+		if(nhve_send(streamer, &frame, RAW_CHANNEL) != NHVE_OK)
+			break;
+		seconds[RAW_CHANNEL] += time_s() - start;
+
+		//depth as RVL compressed auxiliary data (lossless)
+		start = time_s();
+		if(nhve_send(streamer, &frame, RVL_CHANNEL) != NHVE_OK)
+			break;
+		seconds[RVL_CHANNEL] += time_s() - start;
+	}
+
+	//flush the encoder by sending NULL frame
+	nhve_send(streamer, NULL, HEVC_CHANNEL);
+
+	free(color);
+
+	printf("%d frames %dx%d, time is encoding and passing to network stack\n\n", f, WIDTH, HEIGHT);
+	printf("%-10s %12s %12s %10s %12s\n", "channel", "avg size", "max size", "ratio", "avg time ms");
+
+	print_channel_stats(streamer, "hevc10", HEVC_CHANNEL, seconds[HEVC_CHANNEL]);
+	print_channel_stats(streamer, "raw", RAW_CHANNEL, seconds[RAW_CHANNEL]);
+	print_channel_stats(streamer, "rvl", RVL_CHANNEL, seconds[RVL_CHANNEL]);
+
+	printf("\nhevc10 is lossy (depth edges are smeared), raw and rvl are lossless\n");
+
+	return f == FRAMES ? 0 : -1;
+}
+
+void print_channel_stats(struct nhve *streamer, const char *name, uint8_t subframe, double seconds)
+{
+	struct nhve_channel_stats stats;
+
+	if(nhve_get_channel_stats(streamer, subframe, &stats) != NHVE_OK || !stats.frames)
+		return;
+
+	const double raw_size = WIDTH * HEIGHT * 2;
+	const double avg_size = (double)stats.bytes / stats.frames;
+
+	printf("%-10s %12.0f %12d %9.2fx %12.3f\n", name, avg_size, stats.max_size,
+	       raw_size / avg_size, seconds * 1000 / FRAMES);
+}
+
+//pure codec throughput without network, also verifies lossless roundtrip
+int benchmark_rvl(uint16_t *depth, int frames)
+{
+	const int pixels = WIDTH * HEIGHT;
+	uint8_t *encoded = (uint8_t*)malloc(nhve_rvl_encoded_size_max(pixels));
+	uint16_t *decoded = (uint16_t*)malloc(pixels * sizeof(uint16_t));
+	double encode_s = 0, decode_s = 0;
+	uint64_t encoded_bytes = 0;
+	int status = 0;
+
+	if(encoded == NULL || decoded == NULL)
+		status = -1;
+
+	for(int f=0;f<FRAMES && !status;++f)
+	{
+		const uint16_t *d = depth + (size_t)(f % frames) * pixels;
+		double start = time_s();
+
+		const int size = nhve_rvl_encode(d, pixels, encoded);
+
+		encode_s += time_s() - start;
+		encoded_bytes += size;
+
+		start = time_s();
+
+		const int decoded_pixels = nhve_rvl_decode(encoded, size, decoded, pixels);
+
+		decode_s += time_s() - start;
+
+		//verification is not part of decode time
+		if(decoded_pixels != pixels || memcmp(d, decoded, pixels * sizeof(uint16_t)))
+		{
+			fprintf(stderr, "rvl roundtrip failed\n");
+			status = -1;
+		}
+	}
+
+	if(!status)
+	{
+		const double raw_bytes = (double)pixels * sizeof(uint16_t) * FRAMES;
+
+		printf("\nrvl codec only: ratio %.2fx, encode %.2f GB/s (%.3f ms), decode %.2f GB/s (%.3f ms)\n",
+		       raw_bytes / encoded_bytes,
+		       raw_bytes / encode_s / 1e9, encode_s * 1000 / FRAMES,
+		       raw_bytes / decode_s / 1e9, decode_s * 1000 / FRAMES);
+	}
+
+	free(encoded);
+	free(decoded);
+
+	return status;
+}
+
+//returns number of loaded frames or negative on error
+int load_depth(uint16_t **depth)
+{
+	const size_t frame_size = WIDTH * HEIGHT * sizeof(uint16_t);
+	int frames = 0;
+
+	if( (*depth = (uint16_t*)malloc(frame_size * FRAMES)) == NULL )
+		return -1;
+
+	if(strcmp(DEPTH_FILE, "-") == 0)
+	{
+		for(frames=0;frames<FRAMES;++frames)
+			synthetic_depth(*depth + (size_t)frames * WIDTH * HEIGHT, frames);
+
+		return frames;
+	}
+
+	FILE *file = fopen(DEPTH_FILE, "rb");
+
+	if(file == NULL)
+	{
+		fprintf(stderr, "unable to open %s\n", DEPTH_FILE);
+		free(*depth);
+		return -1;
+	}
+
+	while(frames < FRAMES && fread(*depth + (size_t)frames * WIDTH * HEIGHT, frame_size, 1, file) == 1)
+		++frames;
+
+	fclose(file);
+
+	if(!frames)
+	{
+		fprintf(stderr, "%s has no complete %dx%d Z16 frame\n", DEPTH_FILE, WIDTH, HEIGHT);
+		free(*depth);
+		return -1;
+	}
+
+	return frames;
+}
+
+//tilted plane moving with framenumber, sensor noise and invalid (zero) areas
+void synthetic_depth(uint16_t *depth, int f)
+{
+	for(int y=0;y<HEIGHT;++y)
+		for(int x=0;x<WIDTH;++x)
+		{
+			const int invalid = (x < 40) || ((x / 64 + y / 48 + f / 10) % 7 == 0);
+			depth[y*WIDTH + x] = invalid ? 0 : 1000 + 2*y + x + f + rand() % 5;
+		}
+}
+
+int process_user_input(int argc, char* argv[])
+{
+	if(argc < 4)
+	{
+		fprintf(stderr, "Usage: %s <ip> <port> <depth file> [device]\n", argv[0]);
+		fprintf(stderr, "\ndepth file is raw recording of %dx%d Z16 frames or - for synthetic depth\n", WIDTH, HEIGHT);
+		fprintf(stderr, "\nexamples:\n");
+		fprintf(stderr, "%s 127.0.0.1 9766 depth.raw\n", argv[0]);
+		fprintf(stderr, "%s 127.0.0.1 9766 - /dev/dri/renderD128\n", argv[0]);
+		return -1;
+	}
+
+	IP = argv[1];
+	PORT = atoi(argv[2]);
+	DEPTH_FILE = argv[3];
+	DEVICE=argv[4]; //NULL as last argv argument, or device path
+
+	return 0;
+}
+
+int hint_user_on_failure(char *argv[])
+{
+	fprintf(stderr, "unable to initalize, try to specify device e.g:\n\n");
+	fprintf(stderr, "%s 127.0.0.1 9766 - /dev/dri/renderD128\n", argv[0]);
+	return -1;
+}
+
+double time_s()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
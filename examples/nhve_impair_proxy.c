@@ -0,0 +1,305 @@
+/*
+ * NHVE Network Hardware Video Encoder library network impairment proxy
+ *
+ * UDP proxy placed between nhve sender and receiver (e.g. both on loopback)
+ * applying packet loss, delay, jitter (which also reorders packets) and rate limit.
+ * Runs in user space without special privileges.
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include <stdio.h> //printf, fprintf
+#include <stdlib.h> //atoi, atof, malloc, rand_r
+#include <string.h> //memset, memcpy
+#include <inttypes.h> //uint8_t
+#include <time.h> //clock_gettime
+#include <poll.h> //poll
+#include <unistd.h> //close
+#include <arpa/inet.h> //inet_pton, htons
+#include <sys/socket.h> //socket, bind, recvfrom, sendto
+
+unsigned short LISTEN_PORT; //e.g. 9766, nhve sender sends here
+const char *TARGET_IP; //e.g. "127.0.0.1", receiver address
+unsigned short TARGET_PORT; //e.g. 9767, receiver port
+double LOSS; //packet loss in percent
+int DELAY_MS; //one way delay
+int JITTER_MS; //uniform random extra delay in [0, JITTER_MS], reorders packets
+int RATE_KBPS; //bottleneck rate in kbit/s, 0 for unlimited
+unsigned int SEED=1; //random seed, the same seed gives the same loss and jitter pattern
+
+const int QUEUE_MS=100; //bottleneck queue size in time at RATE_KBPS, packets above are dropped
+const int MAX_PACKETS=65536; //max packets in flight
+const int MAX_DATAGRAM=65536; //max UDP datagram size
+const int REPORT_MS=1000; //statistics interval
+
+//packet waiting for release time
+struct packet
+{
+	uint64_t release_us;
+	uint8_t *data;
+	int size;
+};
+
+//binary min-heap of packets ordered by release time
+struct queue
+{
+	struct packet *packets;
+	int size;
+};
+
+struct proxy_stats
+{
+	uint64_t received;
+	uint64_t lost; //random loss
+	uint64_t dropped; //bottleneck queue overflow
+	uint64_t forwarded;
+	uint64_t bytes;
+};
+
+int proxy_loop(int sock, const struct sockaddr_in *target);
+int queue_push(struct queue *q, const struct packet *p);
+void queue_pop(struct queue *q);
+int process_user_input(int argc, char* argv[]);
+uint64_t time_us();
+
+int main(int argc, char* argv[])
+{
+	if( process_user_input(argc, argv) < 0 )
+		return -1;
+
+	struct sockaddr_in listen_address = {0}, target = {0};
+	int sock;
+
+	listen_address.sin_family = AF_INET;
+	listen_address.sin_addr.s_addr = htonl(INADDR_ANY);
+	listen_address.sin_port = htons(LISTEN_PORT);
+
+	target.sin_family = AF_INET;
+	target.sin_port = htons(TARGET_PORT);
+
+	if( inet_pton(AF_INET, TARGET_IP, &target.sin_addr) != 1 )
+	{
+		fprintf(stderr, "failed to parse target ip %s\n", TARGET_IP);
+		return -1;
+	}
+
+	if( (sock = socket(AF_INET, SOCK_DGRAM, 0)) == -1 )
+	{
+		perror("socket");
+		return -1;
+	}
+
+	//bursts of large frames should be queued by proxy, not dropped by kernel
+	const int buffer_size = 8 * 1024 * 1024;
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+	if( bind(sock, (struct sockaddr*)&listen_address, sizeof(listen_address)) == -1 )
+	{
+		perror("bind");
+		close(sock);
+		return -1;
+	}
+
+	printf("proxy :%d -> %s:%d loss %.2f%% delay %d ms jitter %d ms rate %d kbit/s\n",
+	       LISTEN_PORT, TARGET_IP, TARGET_PORT, LOSS, DELAY_MS, JITTER_MS, RATE_KBPS);
+
+	int status = proxy_loop(sock, &target);
+
+	close(sock);
+
+	return status;
+}
+
+int proxy_loop(int sock, const struct sockaddr_in *target)
+{
+	struct queue q = {0};
+	struct proxy_stats stats = {0};
+	uint64_t link_free_us = 0; //time when bottleneck finishes sending queued packets
+	uint64_t report_us = time_us() + REPORT_MS * 1000;
+	uint8_t *buffer = (uint8_t*)malloc(MAX_DATAGRAM);
+	int status = 0;
+
+	if( (q.packets = (struct packet*)malloc(MAX_PACKETS * sizeof(struct packet))) == NULL || buffer == NULL )
+		status = -1;
+
+	while(!status)
+	{
+		uint64_t now_us = time_us();
+		struct pollfd pfd = {sock, POLLIN, 0};
+		int timeout_ms = REPORT_MS;
+
+		//release due packets
+		while(q.size && q.packets[0].release_us <= now_us)
+		{
+			if( sendto(sock, q.packets[0].data, q.packets[0].size, 0, (const struct sockaddr*)target, sizeof(*target)) == -1 )
+				perror("sendto");
+			else
+				++stats.forwarded;
+
+			free(q.packets[0].data);
+			queue_pop(&q);
+		}
+
+		if(now_us >= report_us)
+		{
+			printf("received %llu lost %llu dropped %llu forwarded %llu queued %d bytes %llu\n",
+			       (unsigned long long)stats.received, (unsigned long long)stats.lost,
+			       (unsigned long long)stats.dropped, (unsigned long long)stats.forwarded,
+			       q.size, (unsigned long long)stats.bytes);
+			fflush(stdout);
+			report_us += REPORT_MS * 1000;
+		}
+
+		if(q.size && q.packets[0].release_us - now_us < REPORT_MS * 1000ULL)
+			timeout_ms = (q.packets[0].release_us - now_us + 999) / 1000;
+
+		if( poll(&pfd, 1, timeout_ms) == -1 )
+		{
+			perror("poll");
+			status = -1;
+			break;
+		}
+
+		if( !(pfd.revents & POLLIN) )
+			continue;
+
+		const int size = recvfrom(sock, buffer, MAX_DATAGRAM, 0, NULL, NULL);
+
+		if(size < 0)
+		{
+			perror("recvfrom");
+			continue;
+		}
+
+		now_us = time_us();
+		++stats.received;
+		stats.bytes += size;
+
+		if( rand_r(&SEED) < LOSS / 100.0 * ((double)RAND_MAX + 1) )
+		{
+			++stats.lost;
+			continue;
+		}
+
+		//bottleneck serializes packets in arrival order, queue above QUEUE_MS is dropped
+		uint64_t departure_us = now_us;
+
+		if(RATE_KBPS)
+		{
+			const uint64_t tx_us = (uint64_t)size * 8 * 1000 / RATE_KBPS;
+			departure_us = (link_free_us > now_us ? link_free_us : now_us) + tx_us;
+
+			if(departure_us - now_us > (uint64_t)QUEUE_MS * 1000)
+			{
+				++stats.dropped;
+				continue;
+			}
+
+			link_free_us = departure_us;
+		}
+
+		struct packet p;
+
+		p.release_us = departure_us + DELAY_MS * 1000ULL;
+
+		if(JITTER_MS)
+			p.release_us += rand_r(&SEED) % (JITTER_MS * 1000 + 1);
+
+		p.size = size;
+
+		if( (p.data = (uint8_t*)malloc(size)) == NULL )
+		{
+			++stats.dropped;
+			continue;
+		}
+
+		memcpy(p.data, buffer, size);
+
+		if( queue_push(&q, &p) != 0 )
+		{
+			free(p.data);
+			++stats.dropped;
+		}
+	}
+
+	for(int i=0;i<q.size;++i)
+		free(q.packets[i].data);
+
+	free(q.packets);
+	free(buffer);
+
+	return status;
+}
+
+int queue_push(struct queue *q, const struct packet *p)
+{
+	if(q->size == MAX_PACKETS)
+		return -1;
+
+	int i = q->size++;
+
+	for(;i && q->packets[(i-1)/2].release_us > p->release_us; i = (i-1)/2)
+		q->packets[i] = q->packets[(i-1)/2];
+
+	q->packets[i] = *p;
+
+	return 0;
+}
+
+void queue_pop(struct queue *q)
+{
+	const struct packet last = q->packets[--q->size];
+	int i = 0;
+
+	for(int child = 1; child < q->size; child = 2*i + 1)
+	{
+		if(child + 1 < q->size && q->packets[child+1].release_us < q->packets[child].release_us)
+			++child;
+
+		if(last.release_us <= q->packets[child].release_us)
+			break;
+
+		q->packets[i] = q->packets[child];
+		i = child;
+	}
+
+	if(q->size)
+		q->packets[i] = last;
+}
+
+int process_user_input(int argc, char* argv[])
+{
+	if(argc < 8)
+	{
+		fprintf(stderr, "Usage: %s <listen port> <target ip> <target port> <loss %%> <delay ms> <jitter ms> <rate kbit/s> [seed]\n", argv[0]);
+		fprintf(stderr, "\nexamples:\n");
+		fprintf(stderr, "%s 9766 127.0.0.1 9767 1 20 5 0\n", argv[0]);
+		fprintf(stderr, "%s 9766 127.0.0.1 9767 0.5 40 10 8000 42\n", argv[0]);
+		return -1;
+	}
+
+	LISTEN_PORT = atoi(argv[1]);
+	TARGET_IP = argv[2];
+	TARGET_PORT = atoi(argv[3]);
+	LOSS = atof(argv[4]);
+	DELAY_MS = atoi(argv[5]);
+	JITTER_MS = atoi(argv[6]);
+	RATE_KBPS = atoi(argv[7]);
+
+	if(argc > 8)
+		SEED = atoi(argv[8]);
+
+	return 0;
+}
+
+uint64_t time_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
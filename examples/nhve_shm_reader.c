@@ -0,0 +1,107 @@
+/*
+ * NHVE Network Hardware Video Encoder library example of
+ * reading encoded frames from shared memory transport on the same host
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include <stdio.h> //printf, fprintf
+#include <stdlib.h> //atoi
+#include <time.h> //clock_gettime
+
+#include "../nhve_shm.h"
+
+const char *NAME; //e.g. "/nhve", the same as shm_name in sender nhve_net_config
+int SECONDS=10;
+const int TIMEOUT_MS=500;
+
+int reading_loop(struct nhve_shm *reader);
+int process_user_input(int argc, char* argv[]);
+uint64_t time_us();
+
+int main(int argc, char* argv[])
+{
+	if( process_user_input(argc, argv) < 0 )
+		return -1;
+
+	struct nhve_shm *reader;
+
+	//any number of readers may open the same shared memory
+	if( (reader = nhve_shm_reader_init(NAME)) == NULL )
+	{
+		fprintf(stderr, "unable to open shared memory, is the sender running?\n");
+		return -1;
+	}
+
+	int status = reading_loop(reader);
+
+	nhve_shm_close(reader);
+
+	return status;
+}
+
+int reading_loop(struct nhve_shm *reader)
+{
+	struct nhve_shm_frame frame;
+	const uint64_t end_us = time_us() + SECONDS * 1000000ULL;
+	int status;
+
+	while(time_us() < end_us)
+	{
+		if( (status = nhve_shm_read(reader, &frame, TIMEOUT_MS)) == NHVE_SHM_TIMEOUT )
+			continue;
+
+		if(status == NHVE_SHM_OVERRUN)
+		{
+			fprintf(stderr, "reader too slow, frames lost\n");
+			continue;
+		}
+
+		if(status != NHVE_SHM_OK)
+			return -1;
+
+		//frame.data points directly to shared memory, here you would decode/process it
+		//(e.g. copy it to your decoder input) and then check if it is still valid
+		const uint64_t latency_us = time_us() - frame.timestamp_us;
+
+		if( !nhve_shm_valid(reader, &frame) )
+		{
+			fprintf(stderr, "data overwritten while processing, frame dropped\n");
+			continue;
+		}
+
+		printf("frameset %llu subframe %d size %d latency %llu us\n",
+		       (unsigned long long)frame.framenumber, frame.subframe, frame.size,
+		       (unsigned long long)latency_us);
+	}
+
+	return 0;
+}
+
+int process_user_input(int argc, char* argv[])
+{
+	if(argc < 3)
+	{
+		fprintf(stderr, "Usage: %s <shm name> <seconds>\n", argv[0]);
+		fprintf(stderr, "\nexamples:\n");
+		fprintf(stderr, "%s /nhve 10\n", argv[0]);
+		return -1;
+	}
+
+	NAME = argv[1];
+	SECONDS = atoi(argv[2]);
+
+	return 0;
+}
+
+uint64_t time_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,431 @@
+/*
+ * NHVE Network Hardware Video Encoder library soak test
+ *
+ * Streams for hours to in-process receiver (directly or through nhve-impair-proxy)
+ * and periodically reports decodable frame ratio, latency percentiles, memory and CPU.
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include <stdio.h> //printf, fprintf, fopen
+#include <stdlib.h> //atoi, malloc, calloc
+#include <string.h> //strcmp, memcpy, memset
+#include <inttypes.h> //uint8_t
+#include <unistd.h> //usleep
+#include <pthread.h> //pthread_create
+#include <time.h> //clock_gettime
+#include <sys/resource.h> //getrusage
+
+#include "../nhve.h"
+// Minimal Latency Streaming Protocol library (receiving side)
+#include "../minimal-latency-streaming-protocol/mlsp.h"
+
+const char *IP; //e.g "127.0.0.1", receiver or nhve-impair-proxy address
+unsigned short PORT; //e.g. 9766, receiver or nhve-impair-proxy port
+unsigned short LISTEN_PORT; //e.g. 9767, in-process receiver port
+int SECONDS=3600;
+int VIDEO; //non-zero for hardware encoded video, zero for synthetic payload without hardware
+
+const int WIDTH=640;
+const int HEIGHT=360;
+const int FRAMERATE=30;
+const char *DEVICE; //NULL for default or device e.g. "/dev/dri/renderD128"
+const char *ENCODER=NULL;//NULL for default (h264_vaapi) or FFmpeg encoder e.g. "hevc_vaapi", ...
+const char *PIXEL_FORMAT="nv12"; //NULL / "" for default (NV12) or pixel format e.g. "rgb0"
+const int PROFILE=FF_PROFILE_H264_HIGH; //or FF_PROFILE_H264_MAIN, FF_PROFILE_H264_CONSTRAINED_BASELINE, ...
+const int BFRAMES=0; //max_b_frames, set to 0 to minimize latency, non-zero to minimize size
+const int BITRATE=2000000; //average bitrate in VBR mode (bit_rate != 0 and qp == 0)
+const int QP=0; //quantization parameter in CQP mode (qp != 0 and bit_rate == 0)
+const int GOP_SIZE=30; //group of pictures size, 0 for default (determines keyframe period)
+const int COMPRESSION_LEVEL=0; //speed-quality tradeoff, 0 for default, 1 for the highest quality, 7 for the fastest
+const int LOW_POWER=0; //alternative limited low-power encoding path if non-zero
+
+const int SYNTHETIC_SIZE=8000; //synthetic payload frame size (about 2 Mbit/s at 30 fps)
+const int SYNTHETIC_KEYFRAME_SIZE=32000; //synthetic payload keyframe size every GOP_SIZE frames
+const int REPORT_SECONDS=10;
+const int RECEIVE_TIMEOUT_MS=500;
+const int LATENCY_BUCKET_US=100; //latency histogram resolution
+const int LATENCY_BUCKETS=100000; //latency histogram range (10 s), constant memory for hours of streaming
+
+//channel 0 is video (or synthetic payload), channel 1 is metadata of the frameset
+enum {PAYLOAD_CHANNEL=0, META_CHANNEL=1, CHANNELS=2};
+enum {META_SIZE=21}; //uint64 sequence, uint64 send time, uint32 payload size, uint8 keyframe
+
+//frame lost or damaged breaks decoding until the next keyframe
+struct soak_stats
+{
+	uint64_t sent;
+	uint64_t received; //complete framesets
+	uint64_t decodable; //received and not depending on lost frame
+	uint64_t damaged; //received with unexpected payload size
+	uint32_t *latency_histogram; //of received framesets
+	uint64_t max_latency_us;
+};
+
+struct soak
+{
+	struct nhve *streamer;
+	struct mlsp *receiver;
+	pthread_mutex_t mutex;
+	struct soak_stats interval; //reset every report
+	struct soak_stats total;
+	int stop; //accessed atomically
+	//for memory growth and CPU usage
+	long rss_start_kb;
+	double start_s;
+	double last_s;
+	double last_cpu_s;
+};
+
+int sending_loop(struct soak *s);
+void *receiving_thread(void *soak);
+void report(struct soak *s, const char *name, struct soak_stats *stats, double since_s, double since_cpu_s);
+void stats_add_latency(struct soak_stats *stats, uint64_t latency_us);
+uint64_t stats_percentile_us(const struct soak_stats *stats, int percentile);
+int process_user_input(int argc, char* argv[]);
+long rss_kb();
+double cpu_s();
+uint64_t time_us();
+
+int main(int argc, char* argv[])
+{
+	if( process_user_input(argc, argv) < 0 )
+		return -1;
+
+	struct nhve_net_config net_config = {IP, PORT};
+	struct nhve_hw_config hw_config = {WIDTH, HEIGHT, FRAMERATE, DEVICE, ENCODER,
+                                           PIXEL_FORMAT, PROFILE, BFRAMES, BITRATE,
+	                                   QP, GOP_SIZE, COMPRESSION_LEVEL, LOW_POWER};
+	struct mlsp_config mlsp_config = {NULL, LISTEN_PORT, RECEIVE_TIMEOUT_MS, CHANNELS};
+	struct soak s = {0};
+	pthread_t thread;
+
+	s.interval.latency_histogram = (uint32_t*)calloc(LATENCY_BUCKETS, sizeof(uint32_t));
+	s.total.latency_histogram = (uint32_t*)calloc(LATENCY_BUCKETS, sizeof(uint32_t));
+
+	if(s.interval.latency_histogram == NULL || s.total.latency_histogram == NULL)
+	{
+		fprintf(stderr, "not enough memory for latency histograms\n");
+		free(s.interval.latency_histogram);
+		free(s.total.latency_histogram);
+		return -1;
+	}
+
+	//in synthetic mode both channels are auxiliary, no hardware needed
+	int status = -1;
+
+	if( (s.streamer = nhve_init(&net_config, &hw_config, VIDEO ? 1 : 0, VIDEO ? 1 : 2)) == NULL )
+		fprintf(stderr, "failed to initialize nhve, try synthetic mode or specify device\n");
+	else if( (s.receiver = mlsp_init_server(&mlsp_config)) == NULL )
+		fprintf(stderr, "failed to initialize receiver\n");
+	else if(pthread_mutex_init(&s.mutex, NULL) != 0)
+		fprintf(stderr, "failed to initialize mutex\n");
+	else
+	{
+		s.rss_start_kb = rss_kb();
+		s.start_s = s.last_s = time_us() / 1e6;
+
+		if(pthread_create(&thread, NULL, receiving_thread, &s) != 0)
+			fprintf(stderr, "failed to start receiving thread\n");
+		else
+		{
+			status = sending_loop(&s);
+
+			//give the last frames time to arrive (e.g. through delaying proxy)
+			usleep(RECEIVE_TIMEOUT_MS * 1000);
+
+			__atomic_store_n(&s.stop, 1, __ATOMIC_RELEASE);
+			pthread_join(thread, NULL);
+
+			report(&s, "total", &s.total, s.start_s, 0);
+		}
+
+		pthread_mutex_destroy(&s.mutex);
+	}
+
+	mlsp_close(s.receiver);
+	nhve_close(s.streamer);
+	free(s.interval.latency_histogram);
+	free(s.total.latency_histogram);
+
+	return status;
+}
+
+int sending_loop(struct soak *s)
+{
+	const uint64_t start_us = time_us();
+	uint64_t frames = (uint64_t)SECONDS * FRAMERATE;
+	uint64_t report_us = start_us + REPORT_SECONDS * 1000000ULL;
+	uint64_t encoded = 0, keyframes = 0, f;
+
+	uint8_t *Y = (uint8_t*)malloc(WIDTH*HEIGHT); //NV12 luminance or synthetic payload
+	uint8_t *color = (uint8_t*)malloc(WIDTH*HEIGHT/2); //NV12 color
+	uint8_t meta[META_SIZE];
+
+	if(Y == NULL || color == NULL)
+		frames = 0;
+	else
+		for(int i=0;i<WIDTH*HEIGHT/2;++i)
+			color[i] = 128;
+
+	for(f=0;f<frames;++f)
+	{
+		struct nhve_frame frame = { 0 };
+		struct nhve_channel_stats stats;
+		uint32_t payload_size = 0;
+		uint8_t keyframe = 0;
+		const uint64_t send_us = time_us();
+
+		frame.data[0] = Y;
+
+		if(VIDEO)
+		{
+			//moving through greyscale like the basic example
+			memset(Y, f % 255, WIDTH*HEIGHT);
+			frame.data[1] = color;
+			frame.linesize[0] = frame.linesize[1] = WIDTH;
+		}
+		else
+		{
+			keyframe = f % GOP_SIZE == 0;
+			frame.linesize[0] = keyframe ? SYNTHETIC_KEYFRAME_SIZE : SYNTHETIC_SIZE;
+			memset(Y, f % 255, frame.linesize[0]);
+		}
+
+		if(nhve_send(s->streamer, &frame, PAYLOAD_CHANNEL) != NHVE_OK)
+			break;
+
+		//encoded size and keyframe flag from channel statistics
+		if(nhve_get_channel_stats(s->streamer, PAYLOAD_CHANNEL, &stats) != NHVE_OK)
+			break;
+
+		//no packet (encoder buffering or static frame), payload is sent empty
+		payload_size = stats.frames != encoded ? stats.last_size : 0;
+		encoded = stats.frames;
+
+		if(VIDEO)
+		{
+			keyframe = stats.keyframes != keyframes;
+			keyframes = stats.keyframes;
+		}
+
+		memcpy(meta, &f, 8);
+		memcpy(meta + 8, &send_us, 8);
+		memcpy(meta + 16, &payload_size, 4);
+		meta[20] = keyframe;
+
+		frame.data[0] = meta;
+		frame.data[1] = NULL;
+		frame.linesize[0] = META_SIZE;
+
+		if(nhve_send(s->streamer, &frame, META_CHANNEL) != NHVE_OK)
+			break;
+
+		pthread_mutex_lock(&s->mutex);
+		++s->interval.sent;
+		++s->total.sent;
+		pthread_mutex_unlock(&s->mutex);
+
+		const uint64_t now_us = time_us();
+
+		if(now_us >= report_us)
+		{
+			report(s, "interval", &s->interval, s->last_s, s->last_cpu_s);
+			report_us += REPORT_SECONDS * 1000000ULL;
+		}
+
+		//real time source, sleep until the next frame is due
+		const uint64_t next_us = start_us + (f + 1) * 1000000 / FRAMERATE;
+
+		if(next_us > now_us)
+			usleep(next_us - now_us);
+	}
+
+	if(VIDEO)
+		nhve_send(s->streamer, NULL, PAYLOAD_CHANNEL);
+
+	free(Y);
+	free(color);
+
+	return f == frames ? 0 : -1;
+}
+
+void *receiving_thread(void *soak)
+{
+	struct soak *s = (struct soak*)soak;
+	uint64_t expected = 0; //next expected sequence
+	int broken = 0; //frame lost since the last keyframe
+
+	while(!__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE))
+	{
+		struct mlsp_frame *frames;
+		int error;
+
+		if( (frames = mlsp_receive(s->receiver, &error)) == NULL )
+		{
+			if(error == MLSP_TIMEOUT)
+				mlsp_receive_reset(s->receiver); //drop incomplete framesets after silence
+			continue;
+		}
+
+		const uint64_t now_us = time_us();
+		uint64_t sequence, send_us;
+		uint32_t payload_size;
+
+		if(frames[META_CHANNEL].size != META_SIZE)
+			continue;
+
+		memcpy(&sequence, frames[META_CHANNEL].data, 8);
+		memcpy(&send_us, frames[META_CHANNEL].data + 8, 8);
+		memcpy(&payload_size, frames[META_CHANNEL].data + 16, 4);
+
+		const int keyframe = frames[META_CHANNEL].data[20];
+		const int damaged = (uint32_t)frames[PAYLOAD_CHANNEL].size != payload_size;
+
+		if(sequence < expected) //late duplicate or reordered frameset, already counted as lost
+			continue;
+
+		if(sequence != expected || damaged)
+			broken = 1;
+
+		if(keyframe && !damaged)
+			broken = 0;
+
+		expected = sequence + 1;
+
+		pthread_mutex_lock(&s->mutex);
+
+		struct soak_stats *stats[2] = {&s->interval, &s->total};
+
+		for(int i=0;i<2;++i)
+		{
+			++stats[i]->received;
+			stats[i]->damaged += damaged;
+			stats[i]->decodable += !broken;
+		}
+
+		stats_add_latency(&s->interval, now_us - send_us);
+		stats_add_latency(&s->total, now_us - send_us);
+
+		pthread_mutex_unlock(&s->mutex);
+	}
+
+	return NULL;
+}
+
+void stats_add_latency(struct soak_stats *stats, uint64_t latency_us)
+{
+	const uint64_t bucket = latency_us / LATENCY_BUCKET_US;
+
+	++stats->latency_histogram[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1];
+
+	if(latency_us > stats->max_latency_us)
+		stats->max_latency_us = latency_us;
+}
+
+//upper bound of bucket holding percentile of received framesets latency
+uint64_t stats_percentile_us(const struct soak_stats *stats, int percentile)
+{
+	const uint64_t rank = (stats->received * percentile + 99) / 100;
+	uint64_t count = 0;
+
+	for(int i=0;i<LATENCY_BUCKETS;++i)
+		if( (count += stats->latency_histogram[i]) >= rank && count)
+			return (uint64_t)(i + 1) * LATENCY_BUCKET_US;
+
+	return 0;
+}
+
+//prints statistics, resets interval statistics
+void report(struct soak *s, const char *name, struct soak_stats *stats, double since_s, double since_cpu_s)
+{
+	const double now_s = time_us() / 1e6, cpu = cpu_s();
+	const long rss = rss_kb();
+
+	pthread_mutex_lock(&s->mutex);
+
+	printf("%s sent %llu received %llu decodable %.2f%% damaged %llu"
+	       " latency ms p50 %.1f p95 %.1f p99 %.1f max %.1f"
+	       " rss %ld kB (%+ld kB) cpu %.1f%%\n",
+	       name, (unsigned long long)stats->sent, (unsigned long long)stats->received,
+	       stats->sent ? 100.0 * stats->decodable / stats->sent : 0.0, (unsigned long long)stats->damaged,
+	       stats_percentile_us(stats, 50) / 1000.0, stats_percentile_us(stats, 95) / 1000.0,
+	       stats_percentile_us(stats, 99) / 1000.0, stats->max_latency_us / 1000.0,
+	       rss, rss - s->rss_start_kb, 100.0 * (cpu - since_cpu_s) / (now_s - since_s));
+	fflush(stdout);
+
+	if(stats == &s->interval)
+	{
+		stats->sent = stats->received = stats->decodable = stats->damaged = stats->max_latency_us = 0;
+		memset(stats->latency_histogram, 0, LATENCY_BUCKETS * sizeof(uint32_t));
+
+		s->last_s = now_s;
+		s->last_cpu_s = cpu;
+	}
+
+	pthread_mutex_unlock(&s->mutex);
+}
+
+int process_user_input(int argc, char* argv[])
+{
+	if(argc < 6)
+	{
+		fprintf(stderr, "Usage: %s <ip> <port> <listen port> <seconds> <video|synthetic> [device]\n", argv[0]);
+		fprintf(stderr, "\nexamples (directly or through nhve-impair-proxy on port 9766):\n");
+		fprintf(stderr, "%s 127.0.0.1 9767 9767 60 synthetic\n", argv[0]);
+		fprintf(stderr, "%s 127.0.0.1 9766 9767 36000 synthetic\n", argv[0]);
+		fprintf(stderr, "%s 127.0.0.1 9766 9767 36000 video /dev/dri/renderD128\n", argv[0]);
+		return -1;
+	}
+
+	IP = argv[1];
+	PORT = atoi(argv[2]);
+	LISTEN_PORT = atoi(argv[3]);
+	SECONDS = atoi(argv[4]);
+	VIDEO = strcmp(argv[5], "video") == 0;
+	DEVICE = argv[6]; //NULL as last argv argument, or device path
+
+	return 0;
+}
+
+//resident set size from /proc, no special privileges needed
+long rss_kb()
+{
+	char line[128];
+	long rss = 0;
+	FILE *status = fopen("/proc/self/status", "r");
+
+	if(status == NULL)
+		return 0;
+
+	while(fgets(line, sizeof(line), status))
+		if(sscanf(line, "VmRSS: %ld kB", &rss) == 1)
+			break;
+
+	fclose(status);
+
+	return rss;
+}
+
+//user + system CPU time of the whole process (sender, receiver and library threads)
+double cpu_s()
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+	       usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+uint64_t time_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
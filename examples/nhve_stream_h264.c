@@ -60,6 +60,14 @@ int main(int argc, char* argv[])
 	//do the actual encoding
 	int status = streaming_loop(streamer);
 
+	//encoded sizes, keyframes are the bitrate spikes (see GOP_SIZE)
+	struct nhve_channel_stats stats;
+
+	if(nhve_get_channel_stats(streamer, 0, &stats) == NHVE_OK && stats.frames)
+		printf("frames %llu avg size %llu max size %d keyframes %llu max keyframe size %d\n",
+		       (unsigned long long)stats.frames, (unsigned long long)(stats.bytes / stats.frames),
+		       stats.max_size, (unsigned long long)stats.keyframes, stats.max_keyframe_size);
+
 	nhve_close(streamer);
 
 	if(status == 0)
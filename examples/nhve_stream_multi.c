@@ -34,6 +34,8 @@ const int QP=0; //quantization parameter in CQP mode (qp != 0 and bit_rate == 0)
 const int GOP_SIZE=0; //group of pictures size, 0 for default (determines keyframe period)
 const int COMPRESSION_LEVEL=0; //speed-quality tradeoff, 0 for default, 1 for the highest quality, 7 for the fastest
 const int LOW_POWER=0; //alternative limited low-power encoding path if non-zero
+const int RECOVERY=1; //reinitialize failed encoder in background while the other keeps streaming
+const int QUALITY_INTERVAL=10; //measure PSNR/SSIM of every 10th frame in background, 0 to disable (requires BFRAMES 0)
 
 //IP, PORT, SECONDS and DEVICE are read from user input
 
@@ -59,6 +61,10 @@ int main(int argc, char* argv[])
 
 	struct nhve *streamer;
 
+	//nhve_hw_config fields after LOW_POWER are optional
+	hw_config[0].recovery = hw_config[1].recovery = RECOVERY;
+	hw_config[0].quality_interval = hw_config[1].quality_interval = QUALITY_INTERVAL;
+
 	//initialize library with nhve_multi_init
 	if( (streamer = nhve_init(&net_config, hw_config, 2, 0)) == NULL )
 		return hint_user_on_failure(argv);
@@ -66,6 +72,21 @@ int main(int argc, char* argv[])
 	//do the actual encoding
 	int status = streaming_loop(streamer);
 
+	//failed encoders are reinitialized in background, empty frames are sent meanwhile
+	for(int i=0;i<2;++i)
+	{
+		struct nhve_channel_stats stats;
+
+		if(nhve_get_channel_stats(streamer, i, &stats) == NHVE_OK && stats.recoveries)
+			printf("encoder %d recoveries %llu max recovery time %llu us\n", i,
+			       (unsigned long long)stats.recoveries, (unsigned long long)stats.max_recovery_us);
+
+		//encoder quality at different bitrates
+		if(nhve_get_channel_stats(streamer, i, &stats) == NHVE_OK && stats.quality_frames)
+			printf("encoder %d PSNR avg %.2f min %.2f dB, SSIM avg %.4f min %.4f (%llu frames measured)\n", i,
+			       stats.psnr_avg, stats.psnr_min, stats.ssim_avg, stats.ssim_min, (unsigned long long)stats.quality_frames);
+	}
+
 	nhve_close(streamer);
 
 	if(status == 0)
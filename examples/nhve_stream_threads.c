@@ -0,0 +1,189 @@
+/*
+ * NHVE Network Hardware Video Encoder library example of
+ * streaming video and auxiliary data from different threads
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include <stdio.h> //printf, fprintf
+#include <inttypes.h> //uint8_t
+#include <unistd.h> //usleep
+#include <pthread.h> //pthread_create, pthread_join
+
+#include "../nhve.h"
+
+const char *IP; //e.g "127.0.0.1"
+unsigned short PORT; //e.g. 9667
+
+const int WIDTH=640;
+const int HEIGHT=360;
+const int FRAMERATE=30;
+int SECONDS=10;
+const char *DEVICE; //NULL for default or device e.g. "/dev/dri/renderD128"
+const char *ENCODER=NULL;//NULL for default (h264_vaapi) or FFmpeg encoder e.g. "hevc_vaapi", ...
+const char *PIXEL_FORMAT="nv12"; //NULL / "" for default (NV12) or pixel format e.g. "rgb0"
+const int PROFILE=FF_PROFILE_H264_HIGH; //or FF_PROFILE_H264_MAIN, FF_PROFILE_H264_CONSTRAINED_BASELINE, ...
+const int BFRAMES=0; //max_b_frames, set to 0 to minimize latency, non-zero to minimize size
+const int BITRATE=0; //average bitrate in VBR mode (bit_rate != 0 and qp == 0)
+const int QP=0; //quantization parameter in CQP mode (qp != 0 and bit_rate == 0)
+const int GOP_SIZE=0; //group of pictures size, 0 for default (determines keyframe period)
+const int COMPRESSION_LEVEL=0; //speed-quality tradeoff, 0 for default, 1 for the highest quality, 7 for the fastest
+const int LOW_POWER=0; //alternative limited low-power encoding path if non-zero
+
+//IP, PORT, SECONDS and DEVICE are read from user input
+
+const int AUX_RATE=200; //auxiliary data rate (e.g. IMU), independent of FRAMERATE
+const int AUX_BUFFER_SIZE = 80; //buffer size for preparing auxiliary data
+
+void *video_loop(void *streamer);
+void *auxiliary_loop(void *streamer);
+int process_user_input(int argc, char* argv[]);
+int hint_user_on_failure(char *argv[]);
+void hint_user_on_success();
+
+int main(int argc, char* argv[])
+{
+	//get SECONDS and DEVICE from the command line
+	if( process_user_input(argc, argv) < 0 )
+		return -1;
+
+	//prepare library data
+	struct nhve_net_config net_config = {IP, PORT};
+	struct nhve_hw_config hw_config = {WIDTH, HEIGHT, FRAMERATE, DEVICE, ENCODER,
+	                                   PIXEL_FORMAT, PROFILE, BFRAMES, BITRATE,
+	                                   QP, GOP_SIZE, COMPRESSION_LEVEL, LOW_POWER};
+	struct nhve *streamer;
+
+	//initialize library with nhve_init (1 video channel, 1 auxiliary channel)
+	if( (streamer = nhve_init(&net_config, &hw_config, 1, 1)) == NULL )
+		return hint_user_on_failure(argv);
+
+	//auxiliary data (e.g. IMU) is small and latency critical, don't queue it behind video
+	nhve_set_priority(streamer, 1, NHVE_PRIORITY_HIGH);
+
+	//each channel is sent from its own thread, no application level locking is needed
+	pthread_t video_thread, auxiliary_thread;
+	void *video_status, *auxiliary_status;
+
+	pthread_create(&video_thread, NULL, video_loop, streamer);
+	pthread_create(&auxiliary_thread, NULL, auxiliary_loop, streamer);
+
+	pthread_join(video_thread, &video_status);
+	pthread_join(auxiliary_thread, &auxiliary_status);
+
+	//see how long channels waited for each other
+	struct nhve_stats stats;
+	nhve_get_stats(streamer, &stats);
+
+	for(int p=0;p<NHVE_PRIORITY_LEVELS;++p)
+		if(stats.priority[p].frames)
+			printf("priority %d frames %llu avg delay %llu us max delay %llu us\n", p,
+			       (unsigned long long)stats.priority[p].frames,
+			       (unsigned long long)(stats.priority[p].total_delay_us / stats.priority[p].frames),
+			       (unsigned long long)stats.priority[p].max_delay_us);
+
+	nhve_close(streamer);
+
+	//convention NULL on success, non NULL on failure
+	int status = video_status == NULL && auxiliary_status == NULL ? 0 : -1;
+
+	if(status == 0)
+		hint_user_on_success();
+
+	return status;
+}
+
+void *video_loop(void *streamer)
+{
+	struct nhve_frame frame = { 0 };
+
+	int frames=SECONDS*FRAMERATE, f;
+	const useconds_t useconds_per_frame = 1000000/FRAMERATE;
+
+	//dummy NV12 data, normally you would take it from camera or other source
+	uint8_t Y[WIDTH*HEIGHT]; //dummy NV12 luminance data
+	uint8_t color[WIDTH*HEIGHT/2]; //dummy NV12 color data
+
+	frame.linesize[0] = frame.linesize[1] = WIDTH;
+	frame.data[0]=Y;
+	frame.data[1]=color;
+
+	for(f=0;f<frames;++f)
+	{
+		memset(Y, f % 255, WIDTH*HEIGHT); //NV12 luminance (ride through greyscale)
+		memset(color, 128, WIDTH*HEIGHT/2); //NV12 UV (no color really)
+
+		//encode and send this frame, concurrently with auxiliary thread
+		if(nhve_send(streamer, &frame, 0) != NHVE_OK)
+			break; //break on error
+
+		//simulate real time source (sleep according to framerate)
+		usleep(useconds_per_frame);
+	}
+
+	//flush the encoder by sending NULL frame, encode some last frames returned from hardware
+	nhve_send(streamer, NULL, 0);
+
+	return f == frames ? NULL : streamer;
+}
+
+void *auxiliary_loop(void *streamer)
+{
+	struct nhve_frame frame = { 0 };
+	char aux_data_buffer[AUX_BUFFER_SIZE];
+
+	int samples=SECONDS*AUX_RATE, s;
+	const useconds_t useconds_per_sample = 1000000/AUX_RATE;
+
+	for(s=0;s<samples;++s)
+	{
+		//prepare dummy auxiliary data, normally you would take it from IMU or other source
+		int size = snprintf(aux_data_buffer, AUX_BUFFER_SIZE, "hello world from sample %d", s);
+
+		frame.data[0] = (uint8_t*)aux_data_buffer;
+		frame.linesize[0] = size + 1;
+
+		//this doesn't wait for video encoding in the other thread
+		if(nhve_send(streamer, &frame, 1) != NHVE_OK)
+			break; //break on error
+
+		usleep(useconds_per_sample);
+	}
+
+	return s == samples ? NULL : streamer;
+}
+
+int process_user_input(int argc, char* argv[])
+{
+	if(argc < 4)
+	{
+		fprintf(stderr, "Usage: %s <ip> <port> <seconds> [device]\n", argv[0]);
+		fprintf(stderr, "\nexamples:\n");
+		fprintf(stderr, "%s 127.0.0.1 9766 10\n", argv[0]);
+		fprintf(stderr, "%s 127.0.0.1 9766 10 /dev/dri/renderD128\n", argv[0]);
+		return -1;
+	}
+
+	IP = argv[1];
+	PORT = atoi(argv[2]);
+	SECONDS = atoi(argv[3]);
+	DEVICE=argv[4]; //NULL as last argv argument, or device path
+
+	return 0;
+}
+
+int hint_user_on_failure(char *argv[])
+{
+	fprintf(stderr, "unable to initalize, try to specify device e.g:\n\n");
+	fprintf(stderr, "%s 127.0.0.1 9766 10 /dev/dri/renderD128\n", argv[0]);
+	return -1;
+}
+void hint_user_on_success()
+{
+	printf("finished successfully\n");
+}
@@ -0,0 +1,161 @@
+/*
+ * NHVE Network Hardware Video Encoder library example of
+ * streaming large frame split into tiles encoded in parallel
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include <stdio.h> //printf, fprintf
+#include <inttypes.h> //uint8_t
+#include <unistd.h> //usleep
+#include <stdlib.h> //malloc, free
+#include <string.h> //memset
+
+#include "../nhve.h"
+
+const char *IP; //e.g "127.0.0.1"
+unsigned short PORT; //e.g. 9667 
+
+const int WIDTH=3840; //full frame, split into two tiles side by side
+const int HEIGHT=1080;
+const int TILE_WIDTH=1920;
+const int FRAMERATE=30;
+int SECONDS=10;
+const char *DEVICE; //NULL for default or device e.g. "/dev/dri/renderD128"
+const char *ENCODER=NULL;//NULL for default (h264_vaapi) or FFmpeg encoder e.g. "hevc_vaapi", ...
+const char *PIXEL_FORMAT="nv12"; //NULL / "" for default (NV12) or pixel format e.g. "rgb0"
+const int PROFILE=FF_PROFILE_H264_HIGH; //or FF_PROFILE_H264_MAIN, FF_PROFILE_H264_CONSTRAINED_BASELINE, ...
+const int BFRAMES=0; //max_b_frames, set to 0 to minimize latency, non-zero to minimize size
+const int BITRATE=0; //average bitrate in VBR mode (bit_rate != 0 and qp == 0)
+const int QP=0; //quantization parameter in CQP mode (qp != 0 and bit_rate == 0)
+const int GOP_SIZE=0; //group of pictures size, 0 for default (determines keyframe period)
+const int COMPRESSION_LEVEL=0; //speed-quality tradeoff, 0 for default, 1 for the highest quality, 7 for the fastest
+const int LOW_POWER=0; //alternative limited low-power encoding path if non-zero
+
+//IP, PORT, SECONDS and DEVICE are read from user input
+
+int streaming_loop(struct nhve *streamer);
+int process_user_input(int argc, char* argv[]);
+int hint_user_on_failure(char *argv[]);
+void hint_user_on_success();
+
+int main(int argc, char* argv[])
+{
+	//get SECONDS and DEVICE from the command line
+	if( process_user_input(argc, argv) < 0 )
+		return -1;
+
+	//prepare library data
+	struct nhve_net_config net_config = {IP, PORT};
+	
+	struct nhve_hw_config hw_config[2] =
+	{  //each encoder encodes its tile region (tile_x, tile_y, width, height) of the full frame
+		{TILE_WIDTH, HEIGHT, FRAMERATE, DEVICE, ENCODER, PIXEL_FORMAT, PROFILE, BFRAMES, BITRATE, QP, GOP_SIZE, COMPRESSION_LEVEL, LOW_POWER},
+		{TILE_WIDTH, HEIGHT, FRAMERATE, DEVICE, ENCODER, PIXEL_FORMAT, PROFILE, BFRAMES, BITRATE, QP, GOP_SIZE, COMPRESSION_LEVEL, LOW_POWER}
+	};
+
+	hw_config[1].tile_x = TILE_WIDTH; //the second tile is on the right
+
+	struct nhve *streamer;
+
+	//initialize library with 2 video channels (tiles) and 1 auxiliary channel (tile geometry)
+	if( (streamer = nhve_init(&net_config, hw_config, 2, 1)) == NULL )
+		return hint_user_on_failure(argv);
+
+	//do the actual encoding
+	int status = streaming_loop(streamer);
+
+	nhve_close(streamer);
+
+	if(status == 0)
+		hint_user_on_success();
+
+	return status;
+}
+
+int streaming_loop(struct nhve *streamer)
+{
+	const int TOTAL_FRAMES = SECONDS*FRAMERATE;
+	const useconds_t useconds_per_frame = 1000000/FRAMERATE;
+	int f;
+	struct nhve_frame frame = { 0 };
+
+	//dummy NV12 data of the full frame, too large for stack
+	uint8_t *Y = malloc(WIDTH*HEIGHT);
+	uint8_t *color = malloc(WIDTH*HEIGHT/2);
+
+	if(!Y || !color)
+	{
+		free(Y);
+		free(color);
+		return -1;
+	}
+
+	//fill with your stride (width including padding if any), tiles use the same stride
+	frame.linesize[0] = frame.linesize[1] = WIDTH;
+
+	for(f=0;f<TOTAL_FRAMES;++f)
+	{
+		//prepare dummy image data, normally you would take it from camera or other source
+		memset(Y, f % 255, WIDTH*HEIGHT); //NV12 luminance (ride through greyscale)
+		memset(color, 128, WIDTH*HEIGHT/2); //NV12 UV (no color really)
+
+		//fill nhve_frame with pointers to your full frame data in NV12 pixel format
+		frame.data[0]=Y;
+		frame.data[1]=color;
+
+		//encode tiles in parallel and send them with tile geometry on subframe 2
+		if(nhve_send_tiled(streamer, &frame, 2) != NHVE_OK)
+			break; //break on error
+
+		//simulate real time source (sleep according to framerate)
+		usleep(useconds_per_frame);
+	}
+
+	//flush the encoders by sending NULL frame, encode last frame(s) returned from hardware
+	nhve_send(streamer, NULL, 0);
+	nhve_send(streamer, NULL, 1);
+	nhve_send(streamer, NULL, 2);
+
+	free(Y);
+	free(color);
+
+	//did we encode everything we wanted?
+	//convention 0 on success, negative on failure
+	return f == TOTAL_FRAMES ? 0 : -1;
+}
+
+int process_user_input(int argc, char* argv[])
+{
+	if(argc < 4)
+	{
+		fprintf(stderr, "Usage: %s <ip> <port> <seconds> [device]\n", argv[0]);
+		fprintf(stderr, "\nexamples:\n");
+		fprintf(stderr, "%s 127.0.0.1 9766 10\n", argv[0]);
+		fprintf(stderr, "%s 127.0.0.1 9766 10 /dev/dri/renderD128\n", argv[0]);
+		return -1;
+	}
+	
+	IP = argv[1];
+	PORT = atoi(argv[2]);
+	SECONDS = atoi(argv[3]);
+	DEVICE=argv[4]; //NULL as last argv argument, or device path
+
+	return 0;
+}
+
+int hint_user_on_failure(char *argv[])
+{
+	fprintf(stderr, "unable to initalize, try to specify device e.g:\n\n");
+	fprintf(stderr, "%s 127.0.0.1 9766 10 /dev/dri/renderD128\n", argv[0]);
+	return -1;
+}
+void hint_user_on_success()
+{
+	printf("finished successfully\n");
+}
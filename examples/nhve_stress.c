@@ -0,0 +1,326 @@
+/*
+ * NHVE Network Hardware Video Encoder library multi-threaded stress test
+ *
+ * Sends auxiliary channels concurrently from many threads (one channel per thread)
+ * while control thread queries statistics and changes channel priorities.
+ * In-process receiver checks integrity of every received frame.
+ *
+ * No hardware needed. Build with cmake -DNHVE_TSAN=ON to run under ThreadSanitizer.
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include <stdio.h> //printf, fprintf
+#include <stdlib.h> //atoi, malloc
+#include <string.h> //memcpy
+#include <inttypes.h> //uint8_t
+#include <unistd.h> //usleep
+#include <pthread.h> //pthread_create
+#include <time.h> //clock_gettime
+
+#include "../nhve.h"
+// Minimal Latency Streaming Protocol library (receiving side)
+#include "../minimal-latency-streaming-protocol/mlsp.h"
+
+unsigned short PORT; //e.g. 9767, in-process receiver port on 127.0.0.1
+int THREADS=4; //sending threads, one auxiliary channel per thread
+int SECONDS=10;
+int TOLERANCE_US=0; //0 for ordered framesets or frameset_tolerance_us of timestamp assembler
+
+enum {MAX_THREADS=16};
+enum {HEADER_SIZE=5}; //uint8 channel, uint32 sequence
+const int MAX_FRAME_SIZE=16000;
+const int RECEIVE_TIMEOUT_MS=500;
+
+struct stress;
+
+struct producer
+{
+	struct stress *s;
+	pthread_t thread;
+	int channel;
+	uint64_t sent;
+	int failed;
+};
+
+struct stress
+{
+	struct nhve *streamer;
+	struct mlsp *receiver;
+	struct producer producer[MAX_THREADS];
+	int stop; //accessed atomically
+	//receiver and control thread results, read after join
+	uint64_t received;
+	uint64_t corrupted;
+	uint64_t control_calls;
+	int control_failed;
+};
+
+void *producer_thread(void *producer);
+void *control_thread(void *stress);
+void *receiving_thread(void *stress);
+void fill_frame(uint8_t *data, int size, int channel, uint32_t sequence);
+int valid_frame(const uint8_t *data, int size, int channel);
+int stopped(struct stress *s);
+uint32_t xorshift(uint32_t *state);
+int process_user_input(int argc, char* argv[]);
+uint64_t time_us();
+
+int main(int argc, char* argv[])
+{
+	if( process_user_input(argc, argv) < 0 )
+		return -1;
+
+	struct nhve_net_config net_config = {"127.0.0.1", PORT};
+	struct mlsp_config mlsp_config = {NULL, PORT, RECEIVE_TIMEOUT_MS, THREADS};
+	struct stress s = {0};
+	pthread_t control, receiver;
+	int status = -1, started = 0;
+
+	net_config.frameset_tolerance_us = TOLERANCE_US;
+
+	//no hardware encoders, only auxiliary channels
+	if( (s.streamer = nhve_init(&net_config, NULL, 0, THREADS)) == NULL )
+		fprintf(stderr, "failed to initialize nhve\n");
+	else if( (s.receiver = mlsp_init_server(&mlsp_config)) == NULL )
+		fprintf(stderr, "failed to initialize receiver\n");
+	else if(pthread_create(&receiver, NULL, receiving_thread, &s) != 0)
+		fprintf(stderr, "failed to start receiving thread\n");
+	else
+	{
+		if(pthread_create(&control, NULL, control_thread, &s) != 0)
+			fprintf(stderr, "failed to start control thread\n");
+		else
+		{
+			for(started=0;started<THREADS;++started)
+			{
+				struct producer *p = s.producer + started;
+
+				p->s = &s;
+				p->channel = started;
+
+				if(pthread_create(&p->thread, NULL, producer_thread, p) != 0)
+				{
+					fprintf(stderr, "failed to start producer thread\n");
+					break;
+				}
+			}
+
+			if(started == THREADS)
+				status = 0;
+
+			usleep(SECONDS * 1000000ULL);
+			__atomic_store_n(&s.stop, 1, __ATOMIC_RELEASE);
+
+			for(int i=0;i<started;++i)
+				pthread_join(s.producer[i].thread, NULL);
+
+			pthread_join(control, NULL);
+		}
+
+		pthread_join(receiver, NULL);
+	}
+
+	//sent frames have to match library statistics updated concurrently
+	for(int i=0;i<started;++i)
+	{
+		struct nhve_channel_stats stats;
+		const struct producer *p = s.producer + i;
+
+		if(nhve_get_channel_stats(s.streamer, i, &stats) != NHVE_OK || stats.frames != p->sent || p->failed)
+			status = -1;
+
+		printf("channel %d sent %llu stats frames %llu%s\n", i, (unsigned long long)p->sent,
+		       (unsigned long long)stats.frames, p->failed ? " (send failed)" : "");
+	}
+
+	if(s.corrupted || s.control_failed || !s.received)
+		status = -1;
+
+	printf("received %llu corrupted %llu control calls %llu%s\n",
+	       (unsigned long long)s.received, (unsigned long long)s.corrupted,
+	       (unsigned long long)s.control_calls, s.control_failed ? " (failed)" : "");
+	printf("%s\n", status == 0 ? "stress test passed" : "stress test FAILED");
+
+	mlsp_close(s.receiver);
+	nhve_close(s.streamer);
+
+	return status;
+}
+
+//variable size frames as fast as possible
+void *producer_thread(void *producer)
+{
+	struct producer *p = (struct producer*)producer;
+	uint8_t *data = (uint8_t*)malloc(MAX_FRAME_SIZE);
+	uint32_t state = p->channel + 1, sequence = 0;
+
+	if(data == NULL)
+	{
+		p->failed = 1;
+		return NULL;
+	}
+
+	while(!stopped(p->s))
+	{
+		struct nhve_frame frame = {0};
+		const int size = HEADER_SIZE + xorshift(&state) % (MAX_FRAME_SIZE - HEADER_SIZE);
+
+		fill_frame(data, size, p->channel, sequence++);
+
+		frame.data[0] = data;
+		frame.linesize[0] = size;
+		frame.timestamp_us = time_us();
+
+		if(nhve_send(p->s->streamer, &frame, p->channel) != NHVE_OK)
+		{
+			p->failed = 1;
+			break;
+		}
+
+		++p->sent;
+	}
+
+	free(data);
+
+	return NULL;
+}
+
+//statistics and priorities while channels are being sent
+void *control_thread(void *stress)
+{
+	struct stress *s = (struct stress*)stress;
+	uint32_t state = 12345;
+
+	while(!stopped(s))
+	{
+		struct nhve_stats stats;
+		struct nhve_channel_stats channel_stats;
+		const int channel = xorshift(&state) % THREADS;
+
+		if(nhve_get_stats(s->streamer, &stats) != NHVE_OK ||
+		   nhve_get_channel_stats(s->streamer, channel, &channel_stats) != NHVE_OK ||
+		   nhve_set_priority(s->streamer, channel, xorshift(&state) % NHVE_PRIORITY_LEVELS) != NHVE_OK)
+		{
+			s->control_failed = 1;
+			break;
+		}
+
+		++s->control_calls;
+	}
+
+	return NULL;
+}
+
+void *receiving_thread(void *stress)
+{
+	struct stress *s = (struct stress*)stress;
+	int timeouts = 0;
+
+	//after senders stop wait for the last frames until timeout
+	while(!stopped(s) || timeouts == 0)
+	{
+		struct mlsp_frame *frames;
+		int error;
+
+		if( (frames = mlsp_receive(s->receiver, &error)) == NULL )
+		{
+			if(error == MLSP_TIMEOUT)
+			{
+				mlsp_receive_reset(s->receiver);
+				timeouts += stopped(s);
+			}
+			continue;
+		}
+
+		//empty frames are expected, channels fill framesets independently
+		for(int i=0;i<THREADS;++i)
+		{
+			if(!frames[i].size)
+				continue;
+
+			++s->received;
+			s->corrupted += !valid_frame(frames[i].data, frames[i].size, i);
+		}
+	}
+
+	return NULL;
+}
+
+//header and payload depending on channel and sequence, frames mixed between channels or threads are detected
+void fill_frame(uint8_t *data, int size, int channel, uint32_t sequence)
+{
+	data[0] = channel;
+	memcpy(data + 1, &sequence, 4);
+
+	for(int i=HEADER_SIZE;i<size;++i)
+		data[i] = channel * 31 + sequence + i;
+}
+
+int valid_frame(const uint8_t *data, int size, int channel)
+{
+	uint32_t sequence;
+
+	if(size < HEADER_SIZE || data[0] != channel)
+		return 0;
+
+	memcpy(&sequence, data + 1, 4);
+
+	for(int i=HEADER_SIZE;i<size;++i)
+		if(data[i] != (uint8_t)(channel * 31 + sequence + i))
+			return 0;
+
+	return 1;
+}
+
+int stopped(struct stress *s)
+{
+	return __atomic_load_n(&s->stop, __ATOMIC_ACQUIRE);
+}
+
+uint32_t xorshift(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+int process_user_input(int argc, char* argv[])
+{
+	if(argc < 4)
+	{
+		fprintf(stderr, "Usage: %s <port> <threads> <seconds> [tolerance us]\n", argv[0]);
+		fprintf(stderr, "\nexamples:\n");
+		fprintf(stderr, "%s 9767 4 10\n", argv[0]);
+		fprintf(stderr, "%s 9767 8 60 5000\n", argv[0]);
+		return -1;
+	}
+
+	PORT = atoi(argv[1]);
+	THREADS = atoi(argv[2]);
+	SECONDS = atoi(argv[3]);
+
+	if(argc > 4)
+		TOLERANCE_US = atoi(argv[4]);
+
+	if(THREADS < 1 || THREADS > MAX_THREADS || SECONDS < 1 || TOLERANCE_US < 0)
+	{
+		fprintf(stderr, "threads must be 1-%d, seconds positive, tolerance non-negative\n", MAX_THREADS);
+		return -1;
+	}
+
+	return 0;
+}
+
+uint64_t time_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -15,31 +15,243 @@
 #include "mlsp.h"
 // Hardware Video Encoder library
 #include "hve.h"
+// Shared memory transport for same host consumers
+#include "nhve_shm.h"
+// Lossless depth compression
+#include "nhve_rvl.h"
+// Authenticated encryption (optional, library built with NHVE_ENCRYPTION)
+#include "nhve_crypto.h"
+// Background PSNR/SSIM measurement
+#include "nhve_quality.h"
+
+#include <libavutil/imgutils.h>
 
 #include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define NHVE_X86_64
+#endif
 
 enum NHVE_COMPILE_TIME_CONSTANTS
 {
 	NHVE_MAX_ENCODERS=3, //!< max number of encoders in multi encoding
+	NHVE_STATIC_TILE_BYTES=32, //!< width of static detection tile in bytes
+	NHVE_STATIC_TILE_ROWS=16, //!< height of static detection tile in rows
+	NHVE_STATIC_ROW_STEP=4, //!< static detection samples every NHVE_STATIC_ROW_STEP row
+	NHVE_RECOVERY_RETRY_MS=100, //!< delay between failed attempts to reinitialize encoder
+	NHVE_DEFAULT_GOP_SIZE=12, //!< FFmpeg group of pictures size used with gop_size 0
+	NHVE_TIMESTAMP_QUEUE=32, //!< max number of frames buffered by encoder with tracked timestamps
+};
+
+//static scene detection state, compares sampled rows of the first plane
+//against the last encoded frame tile by tile
+struct nhve_static_detector
+{
+	uint8_t *reference; //sampled rows of the last encoded frame
+	int row_bytes; //bytes of the first plane row without padding
+	int rows; //number of sampled rows
+	int threshold; //max mean absolute difference per byte of static tile
+	int refresh; //encode at least every refresh frame
+	int skipped; //consecutive not encoded frames
+	int valid; //reference holds data
+	int gop_size; //keyframe interval in frames, 0 if unlimited (intra only)
+	int since_keyframe; //frames (encoded or skipped) since the last keyframe
+	uint32_t (*sad_tile)(const uint8_t *a, int a_stride, const uint8_t *b, int b_stride, int rows);
+};
+
+//timestamps of frames passed to encoder, packets take them in output (decode) order
+//used only by thread sending the channel
+struct nhve_timestamp_queue
+{
+	uint64_t timestamp_us[NHVE_TIMESTAMP_QUEUE];
+	uint32_t head;
+	uint32_t tail;
+};
+
+//tile region of the input frame encoded by single encoder (tiled mode)
+struct nhve_tile
+{
+	int x;
+	int y;
+	int width;
+	int height;
+	int log2_chroma_w;
+	int log2_chroma_h;
+	int pixel_step[4]; //bytes per pixel in plane
+};
+
+//single tile encoding job, tiles are encoded concurrently and sent in order
+struct nhve_tile_job
+{
+	struct nhve *n;
+	struct nhve_frame frame; //points to tile region of the input frame
+	uint8_t subframe;
+	AVPacket *encoded_frame; //first encoded packet or NULL
+	int skipped; //static tile, not encoded
+	uint64_t timestamp_us; //timestamp of encoded packet or frame if not encoded
+	int status;
+};
+
+//background reinitialization of failed encoder
+struct nhve_recovery
+{
+	struct nhve *n;
+	uint8_t subframe;
+	struct hve_config config; //strings point to copies below
+	char *device;
+	char *encoder;
+	char *pixel_format;
+	pthread_t thread;
+	int enabled;
+	int running; //thread started and not joined yet, guarded by network_mutex
+	int recovering; //encoder is owned by recovery thread, guarded by network_mutex
+	uint64_t failure_us;
+};
+
+//output buffer of channel processing step, grown on demand
+struct nhve_channel_buffer
+{
+	uint8_t *data;
+	int capacity;
+};
+
+//per channel encryption context with its output buffer
+struct nhve_encryption
+{
+	struct nhve_crypto *crypto;
+	struct nhve_channel_buffer encrypted;
+};
+
+//copy of encoded or auxiliary frame waiting for frameset completion
+struct nhve_pending_frame
+{
+	uint8_t *data;
+	int size;
+	int capacity;
+	int pending;
+};
+
+//auxiliary channel codec with its output buffer
+struct nhve_auxiliary_channel
+{
+	int codec;
+	struct nhve_channel_buffer encoded;
 };
 
 struct nhve
 {
 	struct mlsp *network_streamer;
+	struct nhve_shm *shm_streamer; //alternative to network_streamer
+	uint64_t framenumber; //frameset number for shared memory transport
 	struct hve *hardware_encoder[NHVE_MAX_ENCODERS];
+	struct nhve_static_detector static_detector[NHVE_MAX_ENCODERS];
+	struct nhve_timestamp_queue timestamps[NHVE_MAX_ENCODERS];
+	struct nhve_tile tile[NHVE_MAX_ENCODERS];
+	struct nhve_recovery recovery[NHVE_MAX_ENCODERS];
+	struct nhve_quality *quality[NHVE_MAX_ENCODERS]; //NULL if not measured
 	int hardware_encoders_size;
 	int auxiliary_channels_size;
+	struct nhve_auxiliary_channel *auxiliary_channel; //per auxiliary channel
+	struct nhve_encryption *encryption; //per channel, NULL if not encrypted
+
+	//only network side is shared between channels, encoding is per channel
+	//network is granted to waiting channel with the highest priority
+	pthread_mutex_t network_mutex;
+	pthread_cond_t network_cond;
+	int network_sync_initialized;
+	int network_busy;
+	int network_waiting[NHVE_PRIORITY_LEVELS];
+	uint8_t *priority; //per channel
+	struct nhve_stats stats;
+	struct nhve_channel_stats *channel_stats; //per channel
+	pthread_cond_t recovery_cond; //signals recovery threads to stop
+	int recovery_stop;
+
+	//tiled mode, tile i > 0 is encoded by persistent worker i, the first one by calling thread
+	struct nhve_tile_job tile_job[NHVE_MAX_ENCODERS];
+	pthread_t tile_thread[NHVE_MAX_ENCODERS];
+	int tile_threads; //number of started workers (encoders 1 to tile_threads)
+	pthread_mutex_t tile_mutex;
+	pthread_cond_t tile_cond; //signals workers new tiled frame or stop
+	pthread_cond_t tile_done_cond; //signals caller that all workers finished
+	int tile_sync_initialized;
+	uint64_t tile_generation; //incremented for every tiled frame
+	int tile_pending; //workers not finished with current frame
+	int tile_stop;
+
+	//state below is guarded by network_busy
+	uint8_t *frameset_sent; //per channel, non zero if sent in current frameset
+
+	//frameset assembler (non-zero tolerance), groups frames by timestamp
+	int frameset_tolerance_us;
+	int frameset_max_wait_us; //max time the first pending frame waits for the rest of frameset
+	struct nhve_pending_frame *pending_frame; //per channel
+	int pending_frames;
+	uint64_t pending_timestamp_us; //timestamp of the first frame in pending frameset
+	uint64_t pending_arrival_us; //monotonic time of the first frame in pending frameset
+	uint64_t sent_timestamp_us; //the newest timestamp of the first frame in sent frameset
+	int framesets_sent; //non-zero if sent_timestamp_us is valid
 };
 
 static int nhve_send_video(struct nhve *n, const struct nhve_frame *frame, uint8_t subframe);
 static int nhve_send_auxiliary(struct nhve *n, const struct nhve_frame *frame, uint8_t subframe);
 
+static int nhve_auxiliary_encode(struct nhve *n, struct mlsp_frame *frame, uint8_t subframe);
+static int nhve_channel_buffer_reserve(struct nhve_channel_buffer *b, int size);
+
+static int nhve_tile_init(struct nhve_tile *t, const struct nhve_hw_config *hw_config);
+static int nhve_tile_layout(const struct nhve_hw_config *hw_config, int hw_size, int *tiled);
+static int nhve_tile_workers_start(struct nhve *n);
+static void nhve_tile_workers_stop(struct nhve *n);
+static void *nhve_tile_worker(void *tile_job);
+static void *nhve_tile_encode(void *tile_job);
+static int nhve_tile_send(struct nhve *n, struct nhve_tile_job *job);
+static int nhve_tile_send_geometry(struct nhve *n, int geometry_subframe);
+
+static void nhve_channel_stats_update(struct nhve *n, uint8_t subframe, int size, int keyframe, int skipped);
+
+static int nhve_encryption_init(struct nhve *n, const struct nhve_net_config *net_config, int channels);
+static void nhve_encryption_close(struct nhve *n, int channels);
+static int nhve_encrypt(struct nhve *n, struct mlsp_frame *frame, uint8_t subframe);
+
+static int nhve_network_send(struct nhve *n, const struct mlsp_frame *frame, uint8_t subframe, const uint64_t *timestamp_us);
+static int nhve_network_flush(struct nhve *n, uint8_t subframe);
+static int nhve_network_expire(struct nhve *n, uint8_t subframe);
+static void nhve_network_acquire(struct nhve *n, uint8_t subframe, int flush);
+static void nhve_network_release(struct nhve *n);
+static int nhve_transport_send(struct nhve *n, const struct mlsp_frame *frame, uint8_t subframe);
+static int nhve_frameset_send(struct nhve *n, const struct mlsp_frame *frame, uint8_t subframe);
+static int nhve_assembler_send(struct nhve *n, const struct mlsp_frame *frame, uint8_t subframe, const uint64_t *timestamp_us);
+static int nhve_assembler_add(struct nhve *n, const struct mlsp_frame *frame, uint8_t subframe, const uint64_t *timestamp_us);
+static int nhve_assembler_late(struct nhve *n, uint64_t timestamp_us);
+static int nhve_assembler_flush(struct nhve *n);
+static int nhve_assembler_expired(struct nhve *n);
+
+static int nhve_static_init(struct nhve_static_detector *d, const struct nhve_hw_config *hw_config);
+static int nhve_static_skip(struct nhve_static_detector *d, const struct nhve_frame *frame);
+static void nhve_static_packet(struct nhve_static_detector *d, const AVPacket *packet);
+
+static void nhve_timestamp_push(struct nhve_timestamp_queue *q, uint64_t timestamp_us);
+static uint64_t nhve_timestamp_pop(struct nhve_timestamp_queue *q, uint64_t fallback_us);
+
+static int nhve_video_failure(struct nhve *n, const struct nhve_frame *frame, uint8_t subframe, const char *msg);
+static int nhve_video_empty(struct nhve *n, const struct nhve_frame *frame, uint8_t subframe);
+static int nhve_recovery_init(struct nhve *n, uint8_t subframe, const struct hve_config *config, int enabled);
+static int nhve_recovery_start(struct nhve *n, uint8_t subframe, const char *msg);
+static int nhve_recovery_pending(struct nhve *n, uint8_t subframe);
+static void *nhve_recovery_thread(void *recovery);
+static void nhve_recovery_stop(struct nhve *n);
+
 static struct nhve *nhve_close_and_return_null(struct nhve *n, const char *msg);
 static int NHVE_ERROR_MSG(const char *msg);
 
 struct nhve *nhve_init(const struct nhve_net_config *net_config,const struct nhve_hw_config *hw_config, int hw_size, int aux_size)
 {
 	struct nhve *n, zero_nhve = {0};
+	int tiled;
 	struct mlsp_config mlsp_cfg = {net_config->ip, net_config->port, 0, hw_size + aux_size};
 
 	if(hw_size > NHVE_MAX_ENCODERS)
@@ -50,12 +262,65 @@ struct nhve *nhve_init(const struct nhve_net_config *net_config,const struct nhv
 
 	*n = zero_nhve;
 
-	if( (n->network_streamer = mlsp_init_client(&mlsp_cfg)) == NULL )
+	if(pthread_mutex_init(&n->network_mutex, NULL) != 0)
+		return nhve_close_and_return_null(n, "failed to initialize network mutex");
+
+	if(pthread_cond_init(&n->network_cond, NULL) != 0)
+	{
+		pthread_mutex_destroy(&n->network_mutex);
+		return nhve_close_and_return_null(n, "failed to initialize network condition variable");
+	}
+
+	if(pthread_cond_init(&n->recovery_cond, NULL) != 0)
+	{
+		pthread_cond_destroy(&n->network_cond);
+		pthread_mutex_destroy(&n->network_mutex);
+		return nhve_close_and_return_null(n, "failed to initialize recovery condition variable");
+	}
+
+	n->network_sync_initialized = 1;
+
+	if( (n->frameset_sent = (uint8_t*)calloc(hw_size + aux_size, sizeof(uint8_t))) == NULL )
+		return nhve_close_and_return_null(n, "not enough memory for frameset state");
+
+	if( (n->priority = (uint8_t*)calloc(hw_size + aux_size, sizeof(uint8_t))) == NULL )
+		return nhve_close_and_return_null(n, "not enough memory for channel priorities");
+
+	if( (n->channel_stats = (struct nhve_channel_stats*)calloc(hw_size + aux_size, sizeof(struct nhve_channel_stats))) == NULL )
+		return nhve_close_and_return_null(n, "not enough memory for channel statistics");
+
+	if(aux_size)
+		if( (n->auxiliary_channel = (struct nhve_auxiliary_channel*)calloc(aux_size, sizeof(struct nhve_auxiliary_channel))) == NULL )
+			return nhve_close_and_return_null(n, "not enough memory for auxiliary channels");
+
+	if(net_config->encryption)
+		if(nhve_encryption_init(n, net_config, hw_size + aux_size) != NHVE_OK)
+			return nhve_close_and_return_null(n, "failed to initialize encryption");
+
+	n->frameset_tolerance_us = net_config->frameset_tolerance_us;
+	n->frameset_max_wait_us = net_config->frameset_max_wait_us ? net_config->frameset_max_wait_us : 2 * n->frameset_tolerance_us;
+
+	if(n->frameset_tolerance_us < 0 || n->frameset_max_wait_us < 0)
+		return nhve_close_and_return_null(n, "negative frameset tolerance or max wait");
+
+	if(n->frameset_tolerance_us)
+		if( (n->pending_frame = (struct nhve_pending_frame*)calloc(hw_size + aux_size, sizeof(struct nhve_pending_frame))) == NULL )
+			return nhve_close_and_return_null(n, "not enough memory for frameset assembler");
+
+	if(net_config->shm_name && net_config->shm_name[0])
+	{
+		if( (n->shm_streamer = nhve_shm_writer_init(net_config->shm_name, net_config->shm_size)) == NULL )
+			return nhve_close_and_return_null(n, "failed to initialize shared memory transport");
+	}
+	else if( (n->network_streamer = mlsp_init_client(&mlsp_cfg)) == NULL )
 		return nhve_close_and_return_null(n, "failed to initialize network client");
 
 	n->hardware_encoders_size = hw_size;
 	n->auxiliary_channels_size = aux_size;
 
+	if(nhve_tile_layout(hw_config, hw_size, &tiled) != NHVE_OK)
+		return nhve_close_and_return_null(n, "invalid tile layout");
+
 	for(int i=0;i<hw_size;++i)
 	{
 		struct hve_config hve_cfg = {hw_config[i].width, hw_config[i].height, hw_config[i].width, hw_config[i].height,
@@ -65,8 +330,31 @@ struct nhve *nhve_init(const struct nhve_net_config *net_config,const struct nhv
 
 		if( (n->hardware_encoder[i] = hve_init(&hve_cfg)) == NULL )
 			return nhve_close_and_return_null(n, "failed to initalize hardware encoder");
+
+		if(nhve_static_init(&n->static_detector[i], hw_config + i) != NHVE_OK)
+			return nhve_close_and_return_null(n, "failed to initialize static scene detection");
+
+		if(nhve_tile_init(&n->tile[i], hw_config + i) != NHVE_OK)
+			return nhve_close_and_return_null(n, "failed to initialize tile");
+
+		n->tile_job[i].n = n;
+		n->tile_job[i].subframe = i;
+
+		if(nhve_recovery_init(n, i, &hve_cfg, hw_config[i].recovery) != NHVE_OK)
+			return nhve_close_and_return_null(n, "failed to initialize encoder recovery");
+
+		if(hw_config[i].quality_interval && hw_config[i].max_b_frames)
+			return nhve_close_and_return_null(n, "quality measurement requires max_b_frames 0");
+
+		if(hw_config[i].quality_interval &&
+		  (n->quality[i] = nhve_quality_init(hw_config[i].encoder, hw_config[i].pixel_format,
+		   hw_config[i].width, hw_config[i].height, hw_config[i].quality_interval)) == NULL)
+			return nhve_close_and_return_null(n, "failed to initialize quality measurement");
 	}
 
+	if(tiled && nhve_tile_workers_start(n) != NHVE_OK)
+		return nhve_close_and_return_null(n, "failed to start tile workers");
+
 	return n;
 }
 
@@ -85,9 +373,45 @@ void nhve_close(struct nhve *n)
 	if(n == NULL)
 		return;
 
+	if(n->network_sync_initialized)
+		nhve_recovery_stop(n);
+
+	nhve_tile_workers_stop(n);
+
 	mlsp_close(n->network_streamer);
+	nhve_shm_close(n->shm_streamer);
 	for(int i=0;i<n->hardware_encoders_size;++i)
+	{
+		nhve_quality_close(n->quality[i]);
 		hve_close(n->hardware_encoder[i]);
+		free(n->static_detector[i].reference);
+		free(n->recovery[i].device);
+		free(n->recovery[i].encoder);
+		free(n->recovery[i].pixel_format);
+	}
+
+	if(n->network_sync_initialized)
+	{
+		pthread_cond_destroy(&n->recovery_cond);
+		pthread_cond_destroy(&n->network_cond);
+		pthread_mutex_destroy(&n->network_mutex);
+	}
+
+	if(n->pending_frame)
+		for(int i=0;i<n->hardware_encoders_size + n->auxiliary_channels_size;++i)
+			free(n->pending_frame[i].data);
+
+	if(n->auxiliary_channel)
+		for(int i=0;i<n->auxiliary_channels_size;++i)
+			free(n->auxiliary_channel[i].encoded.data);
+
+	nhve_encryption_close(n, n->hardware_encoders_size + n->auxiliary_channels_size);
+
+	free(n->auxiliary_channel);
+	free(n->pending_frame);
+	free(n->channel_stats);
+	free(n->priority);
+	free(n->frameset_sent);
 	free(n);
 }
 
@@ -96,41 +420,193 @@ int nhve_send(struct nhve *n, const struct nhve_frame *frame, uint8_t subframe)
 	if(subframe >= n->hardware_encoders_size + n->auxiliary_channels_size)
 		return NHVE_ERROR_MSG("subframe exceeds configured video/aux channels");
 
+	//pending frameset is not held longer than max wait even if this call sends nothing
+	if(n->frameset_tolerance_us && nhve_network_expire(n, subframe) != NHVE_OK)
+		return NHVE_ERROR;
+
 	if(subframe < n->hardware_encoders_size)
 		return nhve_send_video(n, frame, subframe);
 
 	return nhve_send_auxiliary(n, frame, subframe);
 }
 
+int nhve_send_tiled(struct nhve *n, const struct nhve_frame *frame, int geometry_subframe)
+{
+	struct nhve_tile_job *job = n->tile_job;
+	int status = NHVE_OK;
+
+	if(frame == NULL)
+		return NHVE_ERROR_MSG("NULL frame in tiled mode (flush encoders with nhve_send)");
+
+	if(geometry_subframe >= 0 &&
+	  (geometry_subframe < n->hardware_encoders_size || geometry_subframe >= n->hardware_encoders_size + n->auxiliary_channels_size))
+		return NHVE_ERROR_MSG("tile geometry subframe is not auxiliary channel");
+
+	//tile frames point to regions of the input frame, no copying
+	//workers are idle here, job n and subframe are set once in nhve_init
+	for(int i=0;i<n->hardware_encoders_size;++i)
+	{
+		const struct nhve_tile *t = n->tile + i;
+
+		job[i].frame = *frame;
+		job[i].encoded_frame = NULL;
+		job[i].skipped = 0;
+		job[i].timestamp_us = frame->timestamp_us;
+		job[i].status = NHVE_OK;
+
+		for(int p=0;p<AV_NUM_DATA_POINTERS && frame->data[p];++p)
+		{
+			const int chroma = p == 1 || p == 2;
+			const int x = chroma ? t->x >> t->log2_chroma_w : t->x;
+			const int y = chroma ? t->y >> t->log2_chroma_h : t->y;
+
+			job[i].frame.data[p] = frame->data[p] + y * frame->linesize[p] + x * t->pixel_step[p & 3];
+		}
+	}
+
+	//the first tile is encoded by calling thread, the rest concurrently by workers
+	if(n->tile_threads)
+	{
+		pthread_mutex_lock(&n->tile_mutex);
+		n->tile_pending = n->tile_threads;
+		++n->tile_generation;
+		pthread_cond_broadcast(&n->tile_cond);
+		pthread_mutex_unlock(&n->tile_mutex);
+	}
+
+	//without workers (layout without tile offsets) tiles are encoded in sequence
+	for(int i=0;i<n->hardware_encoders_size;++i)
+		if(i == 0 || i > n->tile_threads)
+			nhve_tile_encode(job + i);
+
+	if(n->tile_threads)
+	{
+		pthread_mutex_lock(&n->tile_mutex);
+		while(n->tile_pending)
+			pthread_cond_wait(&n->tile_done_cond, &n->tile_mutex);
+		pthread_mutex_unlock(&n->tile_mutex);
+	}
+
+	//send in subframe order as single frameset
+	for(int i=0;i<n->hardware_encoders_size;++i)
+		if(nhve_tile_send(n, job + i) != NHVE_OK)
+			status = NHVE_ERROR;
+
+	if(geometry_subframe >= 0 && nhve_tile_send_geometry(n, geometry_subframe) != NHVE_OK)
+		status = NHVE_ERROR;
+
+	return status;
+}
+
+int nhve_set_priority(struct nhve *n, uint8_t subframe, int priority)
+{
+	if(subframe >= n->hardware_encoders_size + n->auxiliary_channels_size)
+		return NHVE_ERROR_MSG("subframe exceeds configured video/aux channels");
+
+	if(priority < 0 || priority >= NHVE_PRIORITY_LEVELS)
+		return NHVE_ERROR_MSG("priority outside of valid range");
+
+	pthread_mutex_lock(&n->network_mutex);
+	n->priority[subframe] = priority;
+	pthread_mutex_unlock(&n->network_mutex);
+
+	return NHVE_OK;
+}
+
+int nhve_set_auxiliary_codec(struct nhve *n, uint8_t subframe, int codec)
+{
+	if(subframe < n->hardware_encoders_size || subframe >= n->hardware_encoders_size + n->auxiliary_channels_size)
+		return NHVE_ERROR_MSG("subframe is not configured auxiliary channel");
+
+	if(codec != NHVE_AUX_RAW && codec != NHVE_AUX_RVL)
+		return NHVE_ERROR_MSG("unknown auxiliary codec");
+
+	n->auxiliary_channel[subframe - n->hardware_encoders_size].codec = codec;
+
+	return NHVE_OK;
+}
+
+int nhve_get_stats(struct nhve *n, struct nhve_stats *stats)
+{
+	pthread_mutex_lock(&n->network_mutex);
+	*stats = n->stats;
+	pthread_mutex_unlock(&n->network_mutex);
+
+	return NHVE_OK;
+}
+
+int nhve_get_channel_stats(struct nhve *n, uint8_t subframe, struct nhve_channel_stats *stats)
+{
+	if(subframe >= n->hardware_encoders_size + n->auxiliary_channels_size)
+		return NHVE_ERROR_MSG("subframe exceeds configured video/aux channels");
+
+	pthread_mutex_lock(&n->network_mutex);
+	*stats = n->channel_stats[subframe];
+	pthread_mutex_unlock(&n->network_mutex);
+
+	if(subframe < n->hardware_encoders_size && n->quality[subframe])
+	{
+		struct nhve_quality_stats quality;
+
+		nhve_quality_stats(n->quality[subframe], &quality);
+
+		stats->quality_frames = quality.frames;
+		stats->quality_dropped = quality.dropped;
+		stats->psnr = quality.psnr;
+		stats->psnr_min = quality.psnr_min;
+		stats->psnr_avg = quality.psnr_avg;
+		stats->ssim = quality.ssim;
+		stats->ssim_min = quality.ssim_min;
+		stats->ssim_avg = quality.ssim_avg;
+	}
+
+	return NHVE_OK;
+}
+
 //3 scenarios:
 //NULL frame - flush encoder
 //non NULL frame and non NULL frame->data[0] - encode and send (typical)
 //non NULL frame and NULL frame->data[0] - send empty frame
 //this is necessary to support e.g. different framerates or B frames in multi-frame scenario
+//static frames (if detection is enabled) are treated like NULL frame->data[0]
 static int nhve_send_video(struct nhve *n, const struct nhve_frame *frame, uint8_t subframe)
 {
 	struct hve_frame video_frame = {0};
 	struct mlsp_frame network_frame = {0};
 
+	//encoder is being reinitialized after failure
+	if( nhve_recovery_pending(n, subframe) )
+		return nhve_video_empty(n, frame, subframe);
+
 	if(!frame) //NULL frame is valid input - flush the encoder
 		if( hve_send_frame(n->hardware_encoder[subframe], NULL) != HVE_OK)
-			return NHVE_ERROR_MSG("failed to send flush frame to hardware");
+			return nhve_video_failure(n, frame, subframe, "failed to send flush frame to hardware");
 
 	if(frame)
 	{
-		if( !frame->data[0] ) //empty data, send empty MLSP frame
+		//empty data, send empty MLSP frame
+		if( !frame->data[0] )
 		{
-			if( mlsp_send(n->network_streamer, &network_frame, subframe) != MLSP_OK)
-				return NHVE_ERROR_MSG("failed to send frame");
-
-			return NHVE_OK;
+			nhve_channel_stats_update(n, subframe, 0, 0, 0);
+			return nhve_network_send(n, &network_frame, subframe, &frame->timestamp_us);
+		}
+		//unchanged scene, send empty MLSP frame instead of encoding
+		if( nhve_static_skip(&n->static_detector[subframe], frame) )
+		{
+			nhve_channel_stats_update(n, subframe, 0, 0, 1);
+			return nhve_network_send(n, &network_frame, subframe, &frame->timestamp_us);
 		}
 		//copy pointers to data planes and linesizes (just a few bytes)
 		memcpy(video_frame.data, frame->data, sizeof(frame->data));
 		memcpy(video_frame.linesize, frame->linesize, sizeof(frame->linesize));
 
 		if( hve_send_frame(n->hardware_encoder[subframe], &video_frame) != HVE_OK )
-			return NHVE_ERROR_MSG("failed to send frame to hardware");
+			return nhve_video_failure(n, frame, subframe, "failed to send frame to hardware");
+
+		nhve_timestamp_push(n->timestamps + subframe, frame->timestamp_us);
+
+		if(n->quality[subframe])
+			nhve_quality_frame(n->quality[subframe], video_frame.data, video_frame.linesize);
 	}
 
 	AVPacket *encoded_frame;
@@ -141,19 +617,34 @@ static int nhve_send_video(struct nhve *n, const struct nhve_frame *frame, uint8
 	//otherwise the receiving side will not collect packet in multi-frame scenario
 	while( (encoded_frame = hve_receive_packet(n->hardware_encoder[subframe], &failed)) )
 	{
+		//packet may be of earlier frame buffered by encoder
+		const uint64_t timestamp_us = nhve_timestamp_pop(n->timestamps + subframe, frame ? frame->timestamp_us : 0);
+
 		if(network_frame.data)
 			continue; //if we already sent something (flushing), ignore the rest of data
 
 		network_frame.data = encoded_frame->data;
 		network_frame.size = encoded_frame->size;
 
-		if( mlsp_send(n->network_streamer, &network_frame, subframe) != MLSP_OK)
-			return NHVE_ERROR_MSG("failed to send frame");
+		nhve_static_packet(&n->static_detector[subframe], encoded_frame);
+		nhve_channel_stats_update(n, subframe, encoded_frame->size, encoded_frame->flags & AV_PKT_FLAG_KEY, 0);
+
+		if(n->quality[subframe])
+			nhve_quality_packet(n->quality[subframe], encoded_frame);
+
+		if( nhve_network_send(n, &network_frame, subframe, frame ? &timestamp_us : NULL) != NHVE_OK)
+			return NHVE_ERROR;
 	}
 
 	//NULL packet and non-zero failed indicates failure during encoding
+	//(if something was already sent in this call, don't send empty frame)
 	if(failed != HVE_OK)
-		return NHVE_ERROR_MSG("failed to encode frame");
+		return network_frame.data ? nhve_recovery_start(n, subframe, "failed to encode frame") :
+		                            nhve_video_failure(n, frame, subframe, "failed to encode frame");
+
+	//flushing without any data left in encoder, still flush pending frameset
+	if(!frame && !network_frame.data)
+		return nhve_network_flush(n, subframe);
 
 	return NHVE_OK;
 }
@@ -168,12 +659,1057 @@ static int nhve_send_auxiliary(struct nhve *n, const struct nhve_frame *frame, u
 		network_frame.size = frame->linesize[0];
 	}
 
-	if( mlsp_send(n->network_streamer, &network_frame, subframe) != MLSP_OK)
-		return NHVE_ERROR_MSG("failed to send aux frame");
+	const int raw_size = network_frame.size;
+
+	if(raw_size && nhve_auxiliary_encode(n, &network_frame, subframe) != NHVE_OK)
+		return NHVE_ERROR;
+
+	nhve_channel_stats_update(n, subframe, network_frame.size, 0, 0);
+
+	pthread_mutex_lock(&n->network_mutex);
+	n->channel_stats[subframe].raw_bytes += raw_size;
+	pthread_mutex_unlock(&n->network_mutex);
+
+	return nhve_network_send(n, &network_frame, subframe, frame ? &frame->timestamp_us : NULL);
+}
+
+//compresses frame in place (frame points to channel buffer afterwards)
+static int nhve_auxiliary_encode(struct nhve *n, struct mlsp_frame *frame, uint8_t subframe)
+{
+	struct nhve_auxiliary_channel *aux = n->auxiliary_channel + subframe - n->hardware_encoders_size;
+
+	if(aux->codec == NHVE_AUX_RAW)
+		return NHVE_OK;
+
+	const int pixels = frame->size / sizeof(uint16_t);
+	const int size_max = nhve_rvl_encoded_size_max(pixels);
+
+	if(frame->size % sizeof(uint16_t))
+		return NHVE_ERROR_MSG("RVL auxiliary data size is not multiple of 16 bit pixel");
+
+	if(nhve_channel_buffer_reserve(&aux->encoded, size_max) != NHVE_OK)
+		return NHVE_ERROR_MSG("not enough memory for RVL auxiliary data");
+
+	frame->size = nhve_rvl_encode((const uint16_t*)frame->data, pixels, aux->encoded.data);
+	frame->data = aux->encoded.data;
+
+	return NHVE_OK;
+}
+
+//buffers are per channel, the same channel is never sent concurrently
+static int nhve_channel_buffer_reserve(struct nhve_channel_buffer *b, int size)
+{
+	if(b->capacity >= size)
+		return NHVE_OK;
+
+	//previous content is not needed, no realloc
+	free(b->data);
+	b->capacity = 0;
+
+	if( (b->data = (uint8_t*)malloc(size)) == NULL )
+		return NHVE_ERROR;
+
+	b->capacity = size;
+
+	return NHVE_OK;
+}
+
+static int nhve_tile_init(struct nhve_tile *t, const struct nhve_hw_config *hw_config)
+{
+	const char *pixel_format = hw_config->pixel_format;
+	const AVPixFmtDescriptor *desc;
+
+	if(pixel_format == NULL || pixel_format[0] == '\0')
+		pixel_format = "nv12";
+
+	if( (desc = av_pix_fmt_desc_get(av_get_pix_fmt(pixel_format))) == NULL)
+		return NHVE_ERROR_MSG("unknown pixel format for tile");
+
+	t->x = hw_config->tile_x;
+	t->y = hw_config->tile_y;
+	t->width = hw_config->width;
+	t->height = hw_config->height;
+	t->log2_chroma_w = desc->log2_chroma_w;
+	t->log2_chroma_h = desc->log2_chroma_h;
+
+	av_image_fill_max_pixsteps(t->pixel_step, NULL, desc);
+
+	if(t->x < 0 || t->y < 0 || t->x % (1 << t->log2_chroma_w) || t->y % (1 << t->log2_chroma_h))
+		return NHVE_ERROR_MSG("tile offset is negative or not multiple of chroma subsampling");
+
+	return NHVE_OK;
+}
+
+//with any tile offset set tiles must have positive size and must not overlap
+static int nhve_tile_layout(const struct nhve_hw_config *hw_config, int hw_size, int *tiled)
+{
+	*tiled = 0;
+
+	for(int i=0;i<hw_size;++i)
+		if(hw_config[i].tile_x || hw_config[i].tile_y)
+			*tiled = 1;
+
+	if(!*tiled)
+		return NHVE_OK;
+
+	for(int i=0;i<hw_size;++i)
+	{
+		const struct nhve_hw_config *a = hw_config + i;
+
+		if(a->width <= 0 || a->height <= 0)
+			return NHVE_ERROR_MSG("tile has zero size");
+
+		for(int j=i+1;j<hw_size;++j)
+		{
+			const struct nhve_hw_config *b = hw_config + j;
+
+			if(a->tile_x < b->tile_x + b->width && b->tile_x < a->tile_x + a->width &&
+			   a->tile_y < b->tile_y + b->height && b->tile_y < a->tile_y + a->height)
+				return NHVE_ERROR_MSG("tiles overlap");
+		}
+	}
+
+	return NHVE_OK;
+}
+
+static int nhve_tile_workers_start(struct nhve *n)
+{
+	if(pthread_mutex_init(&n->tile_mutex, NULL) != 0)
+		return NHVE_ERROR_MSG("failed to initialize tile mutex");
+
+	if(pthread_cond_init(&n->tile_cond, NULL) != 0)
+	{
+		pthread_mutex_destroy(&n->tile_mutex);
+		return NHVE_ERROR_MSG("failed to initialize tile condition variable");
+	}
+
+	if(pthread_cond_init(&n->tile_done_cond, NULL) != 0)
+	{
+		pthread_cond_destroy(&n->tile_cond);
+		pthread_mutex_destroy(&n->tile_mutex);
+		return NHVE_ERROR_MSG("failed to initialize tile condition variable");
+	}
+
+	n->tile_sync_initialized = 1;
+
+	for(int i=1;i<n->hardware_encoders_size;++i)
+	{
+		if(pthread_create(n->tile_thread + i, NULL, nhve_tile_worker, n->tile_job + i) != 0)
+			return NHVE_ERROR_MSG("failed to create tile worker thread");
+
+		n->tile_threads = i;
+	}
 
 	return NHVE_OK;
 }
 
+static void nhve_tile_workers_stop(struct nhve *n)
+{
+	if(!n->tile_sync_initialized)
+		return;
+
+	pthread_mutex_lock(&n->tile_mutex);
+	n->tile_stop = 1;
+	pthread_cond_broadcast(&n->tile_cond);
+	pthread_mutex_unlock(&n->tile_mutex);
+
+	for(int i=1;i<=n->tile_threads;++i)
+		pthread_join(n->tile_thread[i], NULL);
+
+	pthread_cond_destroy(&n->tile_done_cond);
+	pthread_cond_destroy(&n->tile_cond);
+	pthread_mutex_destroy(&n->tile_mutex);
+}
+
+//encodes its tile of every tiled frame until nhve_close
+static void *nhve_tile_worker(void *tile_job)
+{
+	struct nhve_tile_job *job = (struct nhve_tile_job*)tile_job;
+	struct nhve *n = job->n;
+
+	//workers are started before the first tiled frame (generation 0)
+	uint64_t generation = 0;
+
+	pthread_mutex_lock(&n->tile_mutex);
+
+	while(1)
+	{
+		while(!n->tile_stop && n->tile_generation == generation)
+			pthread_cond_wait(&n->tile_cond, &n->tile_mutex);
+
+		if(n->tile_stop)
+			break;
+
+		generation = n->tile_generation;
+
+		pthread_mutex_unlock(&n->tile_mutex);
+
+		nhve_tile_encode(job);
+
+		pthread_mutex_lock(&n->tile_mutex);
+
+		if(--n->tile_pending == 0)
+			pthread_cond_signal(&n->tile_done_cond);
+	}
+
+	pthread_mutex_unlock(&n->tile_mutex);
+
+	return NULL;
+}
+
+//encodes tile without sending, encoded packet stays valid until next call to the same encoder
+static void *nhve_tile_encode(void *tile_job)
+{
+	struct nhve_tile_job *job = (struct nhve_tile_job*)tile_job;
+	struct nhve *n = job->n;
+	struct hve_frame video_frame = {0};
+	int failed;
+
+	//empty data or encoder being reinitialized, send empty MLSP frame
+	if(!job->frame.data[0] || nhve_recovery_pending(n, job->subframe))
+		return NULL;
+
+	//unchanged tile, send empty MLSP frame instead of encoding
+	if( (job->skipped = nhve_static_skip(&n->static_detector[job->subframe], &job->frame)) )
+		return NULL;
+
+	memcpy(video_frame.data, job->frame.data, sizeof(job->frame.data));
+	memcpy(video_frame.linesize, job->frame.linesize, sizeof(job->frame.linesize));
+
+	if( hve_send_frame(n->hardware_encoder[job->subframe], &video_frame) != HVE_OK )
+	{
+		job->status = nhve_recovery_start(n, job->subframe, "failed to send tile to hardware");
+		return NULL;
+	}
+
+	nhve_timestamp_push(n->timestamps + job->subframe, job->frame.timestamp_us);
+
+	if(n->quality[job->subframe])
+		nhve_quality_frame(n->quality[job->subframe], video_frame.data, video_frame.linesize);
+
+	job->encoded_frame = hve_receive_packet(n->hardware_encoder[job->subframe], &failed);
+
+	if(job->encoded_frame)
+	{
+		job->timestamp_us = nhve_timestamp_pop(n->timestamps + job->subframe, job->frame.timestamp_us);
+		nhve_static_packet(&n->static_detector[job->subframe], job->encoded_frame);
+	}
+
+	if(!job->encoded_frame && failed != HVE_OK)
+		job->status = nhve_recovery_start(n, job->subframe, "failed to encode tile");
+
+	return NULL;
+}
+
+static int nhve_tile_send(struct nhve *n, struct nhve_tile_job *job)
+{
+	struct mlsp_frame network_frame = {0};
+	AVPacket *encoded_frame = job->encoded_frame;
+	int failed;
+
+	if(job->status != NHVE_OK)
+		return NHVE_ERROR;
+
+	if(encoded_frame)
+	{
+		network_frame.data = encoded_frame->data;
+		network_frame.size = encoded_frame->size;
+	}
+
+	nhve_channel_stats_update(n, job->subframe, network_frame.size, encoded_frame && (encoded_frame->flags & AV_PKT_FLAG_KEY), job->skipped);
+
+	if(encoded_frame && n->quality[job->subframe])
+		nhve_quality_packet(n->quality[job->subframe], encoded_frame);
+
+	if( nhve_network_send(n, &network_frame, job->subframe, &job->timestamp_us) != NHVE_OK)
+		return NHVE_ERROR;
+
+	if(!encoded_frame)
+		return NHVE_OK;
+
+	//like in nhve_send_video more than 1 packet is not expected outside flushing
+	while( hve_receive_packet(n->hardware_encoder[job->subframe], &failed) )
+		nhve_timestamp_pop(n->timestamps + job->subframe, 0);
+
+	if(failed != HVE_OK)
+		return nhve_recovery_start(n, job->subframe, "failed to encode tile");
+
+	return NHVE_OK;
+}
+
+static int nhve_tile_send_geometry(struct nhve *n, int geometry_subframe)
+{
+	uint8_t geometry[NHVE_MAX_ENCODERS * 5 * 2];
+	struct nhve_frame frame = {0};
+	int size = 0;
+
+	for(int i=0;i<n->hardware_encoders_size;++i)
+	{
+		const uint16_t values[5] = {i, n->tile[i].x, n->tile[i].y, n->tile[i].width, n->tile[i].height};
+
+		for(int v=0;v<5;++v)
+		{
+			geometry[size++] = values[v] & 0xFF;
+			geometry[size++] = values[v] >> 8;
+		}
+	}
+
+	frame.data[0] = geometry;
+	frame.linesize[0] = size;
+
+	return nhve_send_auxiliary(n, &frame, geometry_subframe);
+}
+
+static void nhve_channel_stats_update(struct nhve *n, uint8_t subframe, int size, int keyframe, int skipped)
+{
+	pthread_mutex_lock(&n->network_mutex);
+
+	struct nhve_channel_stats *stats = n->channel_stats + subframe;
+
+	if(size)
+	{
+		++stats->frames;
+		stats->bytes += size;
+
+		if(size > stats->max_size)
+			stats->max_size = size;
+	}
+	else
+		++stats->empty_frames;
+
+	if(keyframe)
+	{
+		++stats->keyframes;
+		stats->keyframe_bytes += size;
+
+		if(size > stats->max_keyframe_size)
+			stats->max_keyframe_size = size;
+	}
+
+	stats->skipped_frames += skipped;
+	stats->last_size = size;
+
+	pthread_mutex_unlock(&n->network_mutex);
+}
+
+//the only place where channels meet, serialized so that
+//different channels may be sent concurrently from different threads
+//timestamp_us is of the frame (or encoded packet) being sent or NULL when flushing
+static int nhve_network_send(struct nhve *n, const struct mlsp_frame *frame, uint8_t subframe, const uint64_t *timestamp_us)
+{
+	struct mlsp_frame encrypted = *frame;
+	int status;
+
+	//encrypt before waiting for network, channels are encrypted in parallel
+	//empty frames carry no data and are not encrypted
+	if(n->encryption && frame->size)
+	{
+		if(nhve_encrypt(n, &encrypted, subframe) != NHVE_OK)
+			return NHVE_ERROR;
+
+		frame = &encrypted;
+	}
+
+	nhve_network_acquire(n, subframe, 0);
+
+	if(n->frameset_tolerance_us)
+		status = nhve_assembler_send(n, frame, subframe, timestamp_us);
+	else
+		status = nhve_frameset_send(n, frame, subframe);
+
+	nhve_network_release(n);
+
+	return status;
+}
+
+#ifdef NHVE_ENCRYPTION
+
+//per channel contexts, channels may be sent concurrently and each has its own nonce sequence
+static int nhve_encryption_init(struct nhve *n, const struct nhve_net_config *net_config, int channels)
+{
+	if( (n->encryption = (struct nhve_encryption*)calloc(channels, sizeof(struct nhve_encryption))) == NULL )
+		return NHVE_ERROR_MSG("not enough memory for encryption");
+
+	for(int i=0;i<channels;++i)
+		if( (n->encryption[i].crypto = nhve_crypto_init(net_config->encryption, net_config->key)) == NULL )
+			return NHVE_ERROR;
+
+	return NHVE_OK;
+}
+
+static void nhve_encryption_close(struct nhve *n, int channels)
+{
+	if(n->encryption == NULL)
+		return;
+
+	for(int i=0;i<channels;++i)
+	{
+		nhve_crypto_close(n->encryption[i].crypto);
+		free(n->encryption[i].encrypted.data);
+	}
+
+	free(n->encryption);
+}
+
+//encrypts frame, frame points to channel buffer afterwards
+static int nhve_encrypt(struct nhve *n, struct mlsp_frame *frame, uint8_t subframe)
+{
+	struct nhve_encryption *e = n->encryption + subframe;
+	const int size_max = frame->size + NHVE_CRYPTO_OVERHEAD;
+
+	if(nhve_channel_buffer_reserve(&e->encrypted, size_max) != NHVE_OK)
+		return NHVE_ERROR_MSG("not enough memory for encrypted frame");
+
+	if( (frame->size = nhve_crypto_encrypt(e->crypto, frame->data, frame->size, e->encrypted.data, subframe)) < 0 )
+		return NHVE_ERROR;
+
+	frame->data = e->encrypted.data;
+
+	return NHVE_OK;
+}
+
+#else
+
+static int nhve_encryption_init(struct nhve *n, const struct nhve_net_config *net_config, int channels)
+{
+	return NHVE_ERROR_MSG("library built without encryption support (NHVE_ENCRYPTION)");
+}
+
+static void nhve_encryption_close(struct nhve *n, int channels)
+{
+}
+
+static int nhve_encrypt(struct nhve *n, struct mlsp_frame *frame, uint8_t subframe)
+{
+	return NHVE_ERROR;
+}
+
+#endif
+
+static int nhve_network_flush(struct nhve *n, uint8_t subframe)
+{
+	int status = NHVE_OK;
+
+	if(!n->frameset_tolerance_us)
+		return NHVE_OK;
+
+	nhve_network_acquire(n, subframe, 1);
+	status = nhve_assembler_flush(n);
+	nhve_network_release(n);
+
+	return status;
+}
+
+//flushes pending frameset waiting longer than max wait
+static int nhve_network_expire(struct nhve *n, uint8_t subframe)
+{
+	int status = NHVE_OK;
+
+	//pending state may be read under mutex only while nobody owns network,
+	//the owner checks expiration itself in nhve_assembler_send
+	pthread_mutex_lock(&n->network_mutex);
+	const int expired = !n->network_busy && nhve_assembler_expired(n);
+	pthread_mutex_unlock(&n->network_mutex);
+
+	if(!expired)
+		return NHVE_OK;
+
+	nhve_network_acquire(n, subframe, 1);
+
+	//other thread may have flushed or started new frameset in the meantime
+	if(nhve_assembler_expired(n))
+		status = nhve_assembler_flush(n);
+
+	nhve_network_release(n);
+
+	return status;
+}
+
+static uint64_t nhve_time_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int nhve_network_higher_waiting(const struct nhve *n, int priority)
+{
+	for(int p=priority+1;p<NHVE_PRIORITY_LEVELS;++p)
+		if(n->network_waiting[p])
+			return 1;
+
+	return 0;
+}
+
+//waits until network is free and no higher priority channel is waiting
+//network is held only for passing frame to network stack, not for encoding
+//flush acquisitions (pending frameset only) are counted separately from frames
+static void nhve_network_acquire(struct nhve *n, uint8_t subframe, int flush)
+{
+	const uint64_t start_us = nhve_time_us();
+
+	pthread_mutex_lock(&n->network_mutex);
+
+	const int priority = n->priority[subframe];
+
+	++n->network_waiting[priority];
+
+	while(n->network_busy || nhve_network_higher_waiting(n, priority))
+		pthread_cond_wait(&n->network_cond, &n->network_mutex);
+
+	--n->network_waiting[priority];
+	n->network_busy = 1;
+
+	struct nhve_priority_stats *stats = n->stats.priority + priority;
+	const uint64_t delay_us = nhve_time_us() - start_us;
+
+	if(flush)
+		++stats->flushes;
+	else
+	{
+		++stats->frames;
+		stats->total_delay_us += delay_us;
+
+		if(delay_us > stats->max_delay_us)
+			stats->max_delay_us = delay_us;
+	}
+
+	pthread_mutex_unlock(&n->network_mutex);
+}
+
+static void nhve_network_release(struct nhve *n)
+{
+	pthread_mutex_lock(&n->network_mutex);
+	n->network_busy = 0;
+	pthread_cond_broadcast(&n->network_cond);
+	pthread_mutex_unlock(&n->network_mutex);
+}
+
+//MLSP over UDP or shared memory, the last subframe completes frameset
+static int nhve_transport_send(struct nhve *n, const struct mlsp_frame *frame, uint8_t subframe)
+{
+	if(n->network_streamer)
+	{
+		if( mlsp_send(n->network_streamer, frame, subframe) != MLSP_OK)
+			return NHVE_ERROR_MSG("failed to send frame");
+
+		return NHVE_OK;
+	}
+
+	if( nhve_shm_write(n->shm_streamer, frame->data, frame->size, subframe, n->framenumber) != NHVE_SHM_OK)
+		return NHVE_ERROR_MSG("failed to write frame to shared memory");
+
+	if(subframe == n->hardware_encoders_size + n->auxiliary_channels_size - 1)
+		++n->framenumber;
+
+	return NHVE_OK;
+}
+
+//keeps MLSP framesets consistent with channels sent in any order
+//- channel sent again in the same frameset closes it (missing channels as empty frames)
+//- the last channel closes frameset (missing channels as empty frames)
+//for sequential calls in subframe order (typical) it is just mlsp_send
+static int nhve_frameset_send(struct nhve *n, const struct mlsp_frame *frame, uint8_t subframe)
+{
+	const int last = n->hardware_encoders_size + n->auxiliary_channels_size - 1;
+	struct mlsp_frame empty_frame = {0};
+
+	if(n->frameset_sent[subframe] && nhve_frameset_send(n, &empty_frame, last) != NHVE_OK)
+		return NHVE_ERROR;
+
+	if(subframe == last)
+		for(int i=0;i<last;++i)
+			if(!n->frameset_sent[i] && nhve_transport_send(n, &empty_frame, i) != NHVE_OK)
+				return NHVE_ERROR;
+
+	if( nhve_transport_send(n, frame, subframe) != NHVE_OK)
+		return NHVE_ERROR;
+
+	n->frameset_sent[subframe] = 1;
+
+	if(subframe == last)
+		memset(n->frameset_sent, 0, last + 1);
+
+	return NHVE_OK;
+}
+
+//sum of absolute differences of size bytes
+static uint32_t nhve_sad_scalar(const uint8_t *a, const uint8_t *b, int size)
+{
+	uint32_t sad = 0;
+
+	for(int i=0;i<size;++i)
+		sad += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+
+	return sad;
+}
+
+//sum of absolute differences of NHVE_STATIC_TILE_BYTES x rows tile
+static uint32_t nhve_sad_tile_scalar(const uint8_t *a, int a_stride, const uint8_t *b, int b_stride, int rows)
+{
+	uint32_t sad = 0;
+
+	for(int r=0;r<rows;++r)
+		sad += nhve_sad_scalar(a + r * a_stride, b + r * b_stride, NHVE_STATIC_TILE_BYTES);
+
+	return sad;
+}
+
+#ifdef NHVE_X86_64
+__attribute__((target("avx2")))
+static uint32_t nhve_sad_tile_avx2(const uint8_t *a, int a_stride, const uint8_t *b, int b_stride, int rows)
+{
+	__m256i sum = _mm256_setzero_si256();
+
+	for(int r=0;r<rows;++r)
+	{
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + r * a_stride));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + r * b_stride));
+		sum = _mm256_add_epi64(sum, _mm256_sad_epu8(va, vb));
+	}
+
+	__m128i s = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+
+	return (uint32_t)_mm_cvtsi128_si64(s);
+}
+#endif
+
+//frame is static if SAD of every tile is within threshold
+//source rows are sampled, reference holds only sampled rows
+static int nhve_static_frame(const struct nhve_static_detector *d, const struct nhve_frame *frame)
+{
+	const int tile_rows = NHVE_STATIC_TILE_ROWS / NHVE_STATIC_ROW_STEP;
+	const int stride = frame->linesize[0] * NHVE_STATIC_ROW_STEP;
+	const int tiles = d->row_bytes / NHVE_STATIC_TILE_BYTES;
+	const int tail = d->row_bytes % NHVE_STATIC_TILE_BYTES;
+
+	for(int r=0;r<d->rows;r+=tile_rows)
+	{
+		const int rows = d->rows - r < tile_rows ? d->rows - r : tile_rows;
+		const uint8_t *src = frame->data[0] + r * stride;
+		const uint8_t *ref = d->reference + r * d->row_bytes;
+		const uint32_t max_sad = d->threshold * rows * NHVE_STATIC_TILE_BYTES;
+
+		for(int t=0;t<tiles;++t)
+		{
+			const int offset = t * NHVE_STATIC_TILE_BYTES;
+
+			if(d->sad_tile(src + offset, stride, ref + offset, d->row_bytes, rows) > max_sad)
+				return 0;
+		}
+
+		if(!tail)
+			continue;
+
+		uint32_t sad = 0;
+
+		for(int i=0;i<rows;++i)
+			sad += nhve_sad_scalar(src + i * stride + tiles * NHVE_STATIC_TILE_BYTES,
+			                       ref + i * d->row_bytes + tiles * NHVE_STATIC_TILE_BYTES, tail);
+
+		if(sad > (uint32_t)(d->threshold * rows * tail))
+			return 0;
+	}
+
+	return 1;
+}
+
+//groups frames by timestamp into framesets, the frame is copied
+//(encoded packet and user auxiliary data don't outlive nhve_send call)
+static int nhve_assembler_send(struct nhve *n, const struct mlsp_frame *frame, uint8_t subframe, const uint64_t *timestamp_us)
+{
+	//flushing with empty frame, missing subframes are sent as empty anyway
+	if(!timestamp_us && !frame->size)
+		return nhve_assembler_flush(n);
+
+	//frameset waiting too long for missing subframes is sent before anything else
+	if(nhve_assembler_expired(n) && nhve_assembler_flush(n) != NHVE_OK)
+		return NHVE_ERROR;
+
+	if(timestamp_us && nhve_assembler_late(n, *timestamp_us))
+	{
+		pthread_mutex_lock(&n->network_mutex);
+		++n->channel_stats[subframe].late_frames;
+		pthread_mutex_unlock(&n->network_mutex);
+
+		//auxiliary data and empty frames are dropped leaving pending frameset intact
+		if(subframe >= n->hardware_encoders_size || !frame->size)
+			return NHVE_OK;
+
+		//encoded packet is never dropped (receiver would lose reference frames), send it alone
+		if(nhve_assembler_flush(n) != NHVE_OK || nhve_assembler_add(n, frame, subframe, timestamp_us) != NHVE_OK)
+			return NHVE_ERROR;
+
+		return nhve_assembler_flush(n);
+	}
+
+	if(n->pending_frames)
+	{
+		const int64_t delta = timestamp_us ? (int64_t)(*timestamp_us - n->pending_timestamp_us) : 0;
+
+		if(n->pending_frame[subframe].pending || delta > n->frameset_tolerance_us)
+			if(nhve_assembler_flush(n) != NHVE_OK)
+				return NHVE_ERROR;
+	}
+
+	if(nhve_assembler_add(n, frame, subframe, timestamp_us) != NHVE_OK)
+		return NHVE_ERROR;
+
+	//complete frameset or flushing
+	if(n->pending_frames == n->hardware_encoders_size + n->auxiliary_channels_size || !timestamp_us)
+		return nhve_assembler_flush(n);
+
+	return NHVE_OK;
+}
+
+//copies frame to pending frameset, the first frame (with known timestamp) anchors the frameset
+static int nhve_assembler_add(struct nhve *n, const struct mlsp_frame *frame, uint8_t subframe, const uint64_t *timestamp_us)
+{
+	struct nhve_pending_frame *p = n->pending_frame + subframe;
+
+	if(p->capacity < frame->size)
+	{
+		uint8_t *data = (uint8_t*)realloc(p->data, frame->size);
+
+		if(data == NULL)
+			return NHVE_ERROR_MSG("not enough memory for pending frame");
+
+		p->data = data;
+		p->capacity = frame->size;
+	}
+
+	if(frame->size)
+		memcpy(p->data, frame->data, frame->size);
+
+	p->size = frame->size;
+	p->pending = 1;
+
+	if(n->pending_frames++ == 0)
+	{
+		n->pending_timestamp_us = timestamp_us ? *timestamp_us : 0;
+		n->pending_arrival_us = nhve_time_us();
+	}
+
+	return NHVE_OK;
+}
+
+//non-zero if frame is older by more than tolerance than pending frameset
+//or (with nothing pending) than the newest sent frameset
+static int nhve_assembler_late(struct nhve *n, uint64_t timestamp_us)
+{
+	if(!n->pending_frames && !n->framesets_sent)
+		return 0;
+
+	const uint64_t anchor_us = n->pending_frames ? n->pending_timestamp_us : n->sent_timestamp_us;
+
+	return (int64_t)(timestamp_us - anchor_us) < -n->frameset_tolerance_us;
+}
+
+//non-zero if pending frameset waits longer than max wait
+static int nhve_assembler_expired(struct nhve *n)
+{
+	return n->pending_frames && nhve_time_us() - n->pending_arrival_us >= (uint64_t)n->frameset_max_wait_us;
+}
+
+//sends pending frameset in subframe order, missing subframes as empty frames
+static int nhve_assembler_flush(struct nhve *n)
+{
+	const int channels = n->hardware_encoders_size + n->auxiliary_channels_size;
+	int status = NHVE_OK;
+
+	if(!n->pending_frames)
+		return NHVE_OK;
+
+	for(int i=0;i<channels;++i)
+	{
+		struct nhve_pending_frame *p = n->pending_frame + i;
+		struct mlsp_frame network_frame = {0};
+
+		if(p->pending)
+		{
+			network_frame.data = p->data;
+			network_frame.size = p->size;
+		}
+
+		if( nhve_transport_send(n, &network_frame, i) != NHVE_OK)
+			status = NHVE_ERROR;
+
+		p->pending = 0;
+	}
+
+	//frame older than sent frameset is late even with nothing pending
+	if(!n->framesets_sent || n->pending_timestamp_us > n->sent_timestamp_us)
+		n->sent_timestamp_us = n->pending_timestamp_us;
+
+	n->framesets_sent = 1;
+	n->pending_frames = 0;
+
+	return status;
+}
+
+static int nhve_video_failure(struct nhve *n, const struct nhve_frame *frame, uint8_t subframe, const char *msg)
+{
+	if(nhve_recovery_start(n, subframe, msg) != NHVE_OK)
+		return NHVE_ERROR;
+
+	return nhve_video_empty(n, frame, subframe);
+}
+
+static int nhve_video_empty(struct nhve *n, const struct nhve_frame *frame, uint8_t subframe)
+{
+	struct mlsp_frame network_frame = {0};
+
+	//flushing, nothing to flush from encoder, still flush pending frameset
+	if(!frame)
+		return nhve_network_flush(n, subframe);
+
+	nhve_channel_stats_update(n, subframe, 0, 0, 0);
+
+	return nhve_network_send(n, &network_frame, subframe, &frame->timestamp_us);
+}
+
+//hve_config is copied with strings, user configuration may be gone when encoder fails
+static int nhve_recovery_init(struct nhve *n, uint8_t subframe, const struct hve_config *config, int enabled)
+{
+	struct nhve_recovery *r = n->recovery + subframe;
+
+	r->n = n;
+	r->subframe = subframe;
+	r->config = *config;
+	r->enabled = enabled;
+
+	if(!enabled)
+		return NHVE_OK;
+
+	if( (config->device && (r->device = strdup(config->device)) == NULL) ||
+	    (config->encoder && (r->encoder = strdup(config->encoder)) == NULL) ||
+	    (config->pixel_format && (r->pixel_format = strdup(config->pixel_format)) == NULL) )
+		return NHVE_ERROR_MSG("not enough memory for encoder recovery configuration");
+
+	r->config.device = r->device;
+	r->config.encoder = r->encoder;
+	r->config.pixel_format = r->pixel_format;
+
+	return NHVE_OK;
+}
+
+//returns NHVE_OK if recovery was started (failure is handled), NHVE_ERROR otherwise
+static int nhve_recovery_start(struct nhve *n, uint8_t subframe, const char *msg)
+{
+	struct nhve_recovery *r = n->recovery + subframe;
+
+	if(!r->enabled)
+		return NHVE_ERROR_MSG(msg);
+
+	fprintf(stderr, "nhve: %s, reinitializing encoder %d in background\n", msg, subframe);
+
+	//new encoder starts new stream
+	if(n->quality[subframe])
+		nhve_quality_reset(n->quality[subframe]);
+
+	n->timestamps[subframe].head = n->timestamps[subframe].tail = 0;
+
+	pthread_mutex_lock(&n->network_mutex);
+
+	r->failure_us = nhve_time_us();
+	r->recovering = 1;
+	n->channel_stats[subframe].recovering = 1;
+
+	if(pthread_create(&r->thread, NULL, nhve_recovery_thread, r) != 0)
+	{
+		r->recovering = 0;
+		n->channel_stats[subframe].recovering = 0;
+		pthread_mutex_unlock(&n->network_mutex);
+		return NHVE_ERROR_MSG("failed to start encoder recovery");
+	}
+
+	r->running = 1;
+
+	pthread_mutex_unlock(&n->network_mutex);
+
+	return NHVE_OK;
+}
+
+//non-zero while encoder is being reinitialized, joins finished recovery thread
+static int nhve_recovery_pending(struct nhve *n, uint8_t subframe)
+{
+	struct nhve_recovery *r = n->recovery + subframe;
+	int recovering, finished;
+
+	if(!r->enabled)
+		return 0;
+
+	pthread_mutex_lock(&n->network_mutex);
+
+	recovering = r->recovering;
+	finished = r->running && !recovering;
+
+	if(finished)
+		r->running = 0;
+
+	pthread_mutex_unlock(&n->network_mutex);
+
+	if(finished)
+		pthread_join(r->thread, NULL);
+
+	return recovering;
+}
+
+//owns the encoder until recovering is cleared, retries until success or nhve_close
+static void *nhve_recovery_thread(void *recovery)
+{
+	struct nhve_recovery *r = (struct nhve_recovery*)recovery;
+	struct nhve *n = r->n;
+	struct hve *h;
+
+	hve_close(n->hardware_encoder[r->subframe]);
+	n->hardware_encoder[r->subframe] = NULL;
+
+	while( (h = hve_init(&r->config)) == NULL )
+	{
+		struct timespec deadline;
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += NHVE_RECOVERY_RETRY_MS * 1000000L;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+
+		pthread_mutex_lock(&n->network_mutex);
+
+		while(!n->recovery_stop && pthread_cond_timedwait(&n->recovery_cond, &n->network_mutex, &deadline) == 0)
+			;
+
+		const int stop = n->recovery_stop;
+
+		pthread_mutex_unlock(&n->network_mutex);
+
+		if(stop)
+			return NULL;
+	}
+
+	pthread_mutex_lock(&n->network_mutex);
+
+	struct nhve_channel_stats *stats = n->channel_stats + r->subframe;
+	const uint64_t recovery_us = nhve_time_us() - r->failure_us;
+
+	n->hardware_encoder[r->subframe] = h;
+	r->recovering = 0;
+
+	//new stream has to start with keyframe, don't skip static frames before it
+	n->static_detector[r->subframe].valid = 0;
+	n->static_detector[r->subframe].skipped = 0;
+
+	++stats->recoveries;
+	stats->recovery_us += recovery_us;
+	stats->recovering = 0;
+
+	if(recovery_us > stats->max_recovery_us)
+		stats->max_recovery_us = recovery_us;
+
+	pthread_mutex_unlock(&n->network_mutex);
+
+	return NULL;
+}
+
+static void nhve_recovery_stop(struct nhve *n)
+{
+	pthread_mutex_lock(&n->network_mutex);
+	n->recovery_stop = 1;
+	pthread_cond_broadcast(&n->recovery_cond);
+	pthread_mutex_unlock(&n->network_mutex);
+
+	for(int i=0;i<n->hardware_encoders_size;++i)
+		if(n->recovery[i].running)
+			pthread_join(n->recovery[i].thread, NULL);
+}
+
+static int nhve_static_init(struct nhve_static_detector *d, const struct nhve_hw_config *hw_config)
+{
+	const char *pixel_format = hw_config->pixel_format;
+	enum AVPixelFormat pix_fmt;
+
+	if(!hw_config->static_threshold)
+		return NHVE_OK;
+
+	if(pixel_format == NULL || pixel_format[0] == '\0')
+		pixel_format = "nv12";
+
+	if( (pix_fmt = av_get_pix_fmt(pixel_format)) == AV_PIX_FMT_NONE)
+		return NHVE_ERROR_MSG("unknown pixel format for static scene detection");
+
+	if( (d->row_bytes = av_image_get_linesize(pix_fmt, hw_config->width, 0)) <= 0)
+		return NHVE_ERROR_MSG("unable to get linesize for static scene detection");
+
+	d->rows = (hw_config->height + NHVE_STATIC_ROW_STEP - 1) / NHVE_STATIC_ROW_STEP;
+	d->threshold = hw_config->static_threshold;
+	d->refresh = hw_config->static_refresh > 0 ? hw_config->static_refresh : hw_config->framerate;
+	//encoder counts only encoded frames, track keyframe interval in input frames
+	//with intra only (negative gop_size) every encoded frame is keyframe
+	d->gop_size = hw_config->gop_size > 0 ? hw_config->gop_size : hw_config->gop_size ? 0 : NHVE_DEFAULT_GOP_SIZE;
+	d->sad_tile = nhve_sad_tile_scalar;
+
+#ifdef NHVE_X86_64
+	if(__builtin_cpu_supports("avx2"))
+		d->sad_tile = nhve_sad_tile_avx2;
+#endif
+
+	if( (d->reference = (uint8_t*)malloc(d->rows * d->row_bytes)) == NULL)
+		return NHVE_ERROR_MSG("not enough memory for static scene detection");
+
+	return NHVE_OK;
+}
+
+//returns non-zero if frame should not be encoded
+//otherwise updates reference with sampled rows of the frame
+static int nhve_static_skip(struct nhve_static_detector *d, const struct nhve_frame *frame)
+{
+	if(!d->reference)
+		return 0;
+
+	++d->since_keyframe;
+
+	//after gop_size frames without keyframe encode until encoder produces one
+	const int keyframe_due = d->gop_size && d->since_keyframe >= d->gop_size;
+
+	if(d->valid && !keyframe_due && d->skipped + 1 < d->refresh && nhve_static_frame(d, frame))
+	{
+		++d->skipped;
+		return 1;
+	}
+
+	for(int r=0;r<d->rows;++r)
+		memcpy(d->reference + r * d->row_bytes, frame->data[0] + r * NHVE_STATIC_ROW_STEP * frame->linesize[0], d->row_bytes);
+
+	d->skipped = 0;
+	d->valid = 1;
+
+	return 0;
+}
+
+static void nhve_static_packet(struct nhve_static_detector *d, const AVPacket *packet)
+{
+	if(packet->flags & AV_PKT_FLAG_KEY)
+		d->since_keyframe = 0;
+}
+
+//when full (encoder buffering more than expected) the oldest timestamp is lost
+static void nhve_timestamp_push(struct nhve_timestamp_queue *q, uint64_t timestamp_us)
+{
+	if(q->tail - q->head == NHVE_TIMESTAMP_QUEUE)
+		++q->head;
+
+	q->timestamp_us[q->tail++ % NHVE_TIMESTAMP_QUEUE] = timestamp_us;
+}
+
+static uint64_t nhve_timestamp_pop(struct nhve_timestamp_queue *q, uint64_t fallback_us)
+{
+	if(q->head == q->tail)
+		return fallback_us;
+
+	return q->timestamp_us[q->head++ % NHVE_TIMESTAMP_QUEUE];
+}
+
 static int NHVE_ERROR_MSG(const char *msg)
 {
 	fprintf(stderr, "nhve: %s\n", msg);
@@ -50,6 +50,12 @@ struct nhve_hw_config
 	int gop_size; //!<  group of pictures size, 0 for default, -1 for intra only
 	int compression_level; //!< speed-quality tradeoff, 0 for default, 1 for the highest quality, 7 for the fastest
 	int low_power; //!< alternative limited low-power encoding if non-zero
+	int static_threshold; //!< 0 to disable or max mean absolute difference per sampled byte of any tile to skip encoding static frame
+	int static_refresh; //!< with static_threshold, encode at least every static_refresh frame, 0 for default (framerate), see nhve_send
+	int tile_x; //!< tiled mode, horizontal offset of this encoder tile in input frame
+	int tile_y; //!< tiled mode, vertical offset of this encoder tile in input frame
+	int recovery; //!< non-zero to reinitialize failed encoder in background, empty frames are sent meanwhile
+	int quality_interval; //!< 0 to disable or measure luma PSNR/SSIM of every quality_interval frame in background (requires max_b_frames 0)
 };
 
 /**
@@ -59,12 +65,24 @@ struct nhve_hw_config
  * For more details see:
  * <a href="https://github.com/bmegli/minimal-latency-streaming-protocol">MLSP</a>
  *
+ * With non-empty shm_name frames are published in shared memory ring buffer
+ * for consumers on the same host instead of sending over UDP (see nhve_shm.h).
+ *
+ * With non-zero encryption every non-empty frame is encrypted and authenticated
+ * with pre-shared key (see nhve_crypto.h). Requires library built with NHVE_ENCRYPTION.
+ *
  * @see nhve_init
  */
 struct nhve_net_config
 {
 	const char *ip; //!< IP (send to)
 	uint16_t port; //!< server port
+	int frameset_tolerance_us; //!< 0 for strict subframe order or max timestamp difference of frames grouped in frameset
+	int frameset_max_wait_us; //!< 0 for default (2 x frameset_tolerance_us) or max time incomplete frameset is held
+	const char *shm_name; //!< NULL / "" for UDP or POSIX shared memory name, e.g. "/nhve"
+	int shm_size; //!< shared memory ring buffer size in bytes, 0 for default
+	int encryption; //!< 0 for none or cipher, e.g. NHVE_CRYPTO_AES_256_GCM from nhve_crypto.h
+	const uint8_t *key; //!< pre-shared key of NHVE_CRYPTO_KEY_SIZE bytes with non-zero encryption
 };
 
 /**
@@ -76,12 +94,105 @@ struct nhve_net_config
  *
  * For non planar formats or auxiliary data only data[0] and linesize[0] is used.
  *
- * @see nhve_send
+ * Fill timestamp_us if frameset assembler is enabled (non-zero frameset_tolerance_us).
+ *
+ * @see nhve_send, nhve_net_config
  */
 struct nhve_frame
 {
 	uint8_t *data[AV_NUM_DATA_POINTERS]; //!< array of pointers to frame planes (e.g. Y plane and UV plane)
 	int linesize[AV_NUM_DATA_POINTERS]; //!< array of strides (width + padding) for planar frame formats
+	uint64_t timestamp_us; //!< capture timestamp in microseconds (used only by frameset assembler)
+};
+
+/**
+ * @brief Channel priorities for access to shared network path
+ *
+ * @see nhve_set_priority
+ */
+enum nhve_priority_enum
+{
+	NHVE_PRIORITY_NORMAL=0, //!< default, e.g. bulk video
+	NHVE_PRIORITY_HIGH=1, //!< e.g. odometry
+	NHVE_PRIORITY_CRITICAL=2, //!< e.g. control
+	NHVE_PRIORITY_LEVELS=3, //!< number of priority levels
+};
+
+/**
+ * @brief Auxiliary channel codecs
+ *
+ * @see nhve_set_auxiliary_codec
+ */
+enum nhve_auxiliary_codec_enum
+{
+	NHVE_AUX_RAW=0, //!< default, raw data is sent
+	NHVE_AUX_RVL=1, //!< lossless depth compression of 16 bit data (see nhve_rvl.h)
+};
+
+/**
+ * @struct nhve_priority_stats
+ * @brief Queueing statistics of single priority level.
+ *
+ * Queueing delay is time spent waiting for network path used by other channels.
+ * Delay is measured for frames only, not for flushes of pending frameset (frameset assembler).
+ *
+ * @see nhve_stats
+ */
+struct nhve_priority_stats
+{
+	uint64_t frames; //!< number of frames passed to network
+	uint64_t total_delay_us; //!< sum of queueing delays
+	uint64_t max_delay_us; //!< max queueing delay
+	uint64_t flushes; //!< number of pending frameset flushes not triggered by frame (not counted in frames)
+};
+
+/**
+ * @struct nhve_stats
+ * @brief Library statistics.
+ *
+ * @see nhve_get_stats
+ */
+struct nhve_stats
+{
+	struct nhve_priority_stats priority[NHVE_PRIORITY_LEVELS]; //!< per priority level queueing statistics
+};
+
+/**
+ * @struct nhve_channel_stats
+ * @brief Statistics of single channel (subframe).
+ *
+ * Sizes are encoded sizes for video channels and raw or compressed sizes for auxiliary channels.
+ * Compare max_keyframe_size with average frame size (bytes / frames) to see bitrate spikes.
+ * Quality is measured against decoded copy of the stream before it is sent over network,
+ * it shows encoder quality, not network losses.
+ *
+ * @see nhve_get_channel_stats
+ */
+struct nhve_channel_stats
+{
+	uint64_t frames; //!< number of sent non-empty frames
+	uint64_t empty_frames; //!< number of sent empty frames (including skipped static frames)
+	uint64_t skipped_frames; //!< number of static frames not encoded
+	uint64_t late_frames; //!< number of late frames in frameset assembler (auxiliary dropped, video sent alone)
+	uint64_t bytes; //!< total size of sent frames
+	uint64_t keyframes; //!< number of sent keyframes (video only)
+	uint64_t keyframe_bytes; //!< total size of sent keyframes (video only)
+	int last_size; //!< size of the last frame
+	int max_size; //!< max frame size
+	int max_keyframe_size; //!< max keyframe size (video only)
+	uint64_t raw_bytes; //!< total size of data before compression (auxiliary only)
+	uint64_t recoveries; //!< number of completed encoder recoveries (video only)
+	uint64_t recovery_us; //!< total time from encoder failure to reinitialized encoder (video only)
+	uint64_t max_recovery_us; //!< max time from encoder failure to reinitialized encoder (video only)
+	int recovering; //!< non-zero while failed encoder is being reinitialized (video only)
+	uint64_t quality_frames; //!< number of frames with measured quality (video with quality_interval only)
+	uint64_t quality_dropped; //!< number of packets not decoded because quality monitor was behind
+	double psnr; //!< luma PSNR of the last measured frame in dB
+	double psnr_min; //!< min luma PSNR in dB
+	double psnr_avg; //!< average luma PSNR in dB
+	double ssim; //!< luma SSIM of the last measured frame
+	double ssim_min; //!< min luma SSIM
+	double ssim_avg; //!< average luma SSIM
 };
 
 /**
@@ -142,12 +253,39 @@ void nhve_close(struct nhve *n);
  * - NULL frame to flush encoder
  * - NULL frame->data[0] is legal, results in sending empty frame
  * - this is necessary to support e.g. different framerates or B frames in multi-frame scenario
+ * - with non-zero static_threshold unchanged (static) frames are not encoded, empty frame is sent instead
+ *   (encoder GOP counts only encoded frames, after gop_size frames without keyframe skipping stops
+ *   until encoder produces keyframe, keyframe interval may grow up to 2x gop_size frames)
+ * - with non-zero recovery encoder failure is not an error, encoder is reinitialized in background
+ *   and empty frames are sent meanwhile (other channels are not affected)
  *
  * For auxiliary frames:
  * - only frame->data[0] of size frame->linesize[0] is sent
+ * - with NHVE_AUX_RVL codec frame->data[0] is 16 bit depth and is compressed losslessly before sending
  * - NULL frame is legal, results in sending empty frame
  * - NULL frame->data is legal, results in sending empty frame
  *
+ * Thread safety:
+ * - different subframes may be sent concurrently from different threads (e.g. camera and IMU thread)
+ * - the same subframe must not be sent concurrently
+ * - encoding is done in parallel, only passing data to network stack is serialized
+ * - subframe sent again before frameset is complete closes the frameset (missing subframes sent as empty)
+ * - the last subframe closes the frameset (missing subframes sent as empty)
+ *
+ * Frameset assembler (non-zero frameset_tolerance_us in nhve_net_config):
+ * - subframes may be sent in any order with frame->timestamp_us
+ * - frames within frameset_tolerance_us of the first frame in frameset are grouped together
+ * - encoded video is grouped by timestamp of the frame the packet was encoded from
+ *   (encoder may output packet of earlier frame, e.g. with B-frames in decode order)
+ * - frameset is sent when complete, on newer frame outside tolerance or on subframe sent again
+ * - frameset is sent when its first frame arrived more than frameset_max_wait_us ago (checked on every nhve_send)
+ * - missing subframes are sent as empty, added latency is bounded by frameset_max_wait_us as long as nhve_send is called
+ * - late frame is older by more than tolerance than pending frameset (or the newest sent frameset if nothing is pending)
+ * - late auxiliary or empty frame is dropped, pending frameset is not affected
+ * - late encoded video is never dropped, pending frameset is sent and the packet follows in its own frameset
+ * - late frames are counted in late_frames
+ * - NULL frame (flush) sends pending frameset immediately
+ *
  * @param n pointer to internal library data
  * @param frame pointer to video data or raw auxiliary data
  * @param subframe determines subframe (channel) as defined by nhve_init hw_size and aux_size
@@ -161,6 +299,111 @@ void nhve_close(struct nhve *n);
  */
 int nhve_send(struct nhve *n, const struct nhve_frame *frame, uint8_t subframe);
 
+/**
+ * @brief Encode single large frame split into tiles by multiple encoders in parallel
+ *
+ * Every hardware encoder (video channel) encodes its tile region of the frame.
+ * Tile region is tile_x, tile_y, width, height of encoder nhve_hw_config.
+ * Tile data is not copied, tiles point to frame data with frame stride.
+ * Tile offsets must be multiples of chroma subsampling (e.g. even for NV12).
+ * With any tile offset set nhve_init checks that tiles don't overlap.
+ * Caller is responsible for frame covering all tiles (tile_x + width, tile_y + height within frame),
+ * frame dimensions are not known to the library.
+ *
+ * Tiles are encoded concurrently (by worker threads started in nhve_init) and sent in subframe order as single frameset.
+ *
+ * Optionally tile geometry is sent on auxiliary geometry_subframe so that receiver can reassemble the frame.
+ * Geometry is sequence of 5 little endian uint16 values per tile: subframe, x, y, width, height.
+ *
+ * Flush encoders as usual with nhve_send(n, NULL, subframe) for every video channel.
+ *
+ * @param n pointer to internal library data
+ * @param frame pointer to full (not tiled) video data, not NULL
+ * @param geometry_subframe auxiliary subframe for tile geometry or negative for none
+ * @return
+ * - NHVE_OK on success
+ * - NHVE_ERROR on error
+ *
+ * @see nhve_init, nhve_hw_config, nhve_send
+ */
+int nhve_send_tiled(struct nhve *n, const struct nhve_frame *frame, int geometry_subframe);
+
+/**
+ * @brief Set channel priority
+ *
+ * All channels share single network path, frames are passed to it one at a time.
+ * When it is busy, waiting frames of higher priority channels are passed first.
+ * This matters only when channels are sent from different threads.
+ *
+ * Frames are not interleaved at packet level, high priority frame waits
+ * at most for single frame being sent.
+ *
+ * By default all channels have NHVE_PRIORITY_NORMAL.
+ *
+ * @param n pointer to internal library data
+ * @param subframe determines subframe (channel) as defined by nhve_init hw_size and aux_size
+ * @param priority one of nhve_priority_enum levels
+ * @return
+ * - NHVE_OK on success
+ * - NHVE_ERROR on error
+ *
+ * @see nhve_send, nhve_priority_enum
+ */
+int nhve_set_priority(struct nhve *n, uint8_t subframe, int priority);
+
+/**
+ * @brief Set auxiliary channel codec
+ *
+ * By default auxiliary data is sent raw (NHVE_AUX_RAW).
+ *
+ * With NHVE_AUX_RVL auxiliary frame->data[0] is interpreted as
+ * frame->linesize[0] / 2 pixels of 16 bit depth (e.g. Realsense Z16)
+ * and compressed losslessly before sending. Use nhve_rvl_decode on receiving side.
+ *
+ * Call before sending on the channel.
+ *
+ * @param n pointer to internal library data
+ * @param subframe determines auxiliary subframe (channel) as defined by nhve_init hw_size and aux_size
+ * @param codec one of nhve_auxiliary_codec_enum
+ * @return
+ * - NHVE_OK on success
+ * - NHVE_ERROR on error
+ *
+ * @see nhve_send, nhve_auxiliary_codec_enum, nhve_rvl.h
+ */
+int nhve_set_auxiliary_codec(struct nhve *n, uint8_t subframe, int codec);
+
+/**
+ * @brief Get library statistics
+ *
+ * May be called concurrently with nhve_send.
+ *
+ * @param n pointer to internal library data
+ * @param stats statistics to fill
+ * @return
+ * - NHVE_OK on success
+ * - NHVE_ERROR on error
+ *
+ * @see nhve_stats
+ */
+int nhve_get_stats(struct nhve *n, struct nhve_stats *stats);
+
+/**
+ * @brief Get channel statistics
+ *
+ * May be called concurrently with nhve_send.
+ *
+ * @param n pointer to internal library data
+ * @param subframe determines subframe (channel) as defined by nhve_init hw_size and aux_size
+ * @param stats statistics to fill
+ * @return
+ * - NHVE_OK on success
+ * - NHVE_ERROR on error
+ *
+ * @see nhve_channel_stats
+ */
+int nhve_get_channel_stats(struct nhve *n, uint8_t subframe, struct nhve_channel_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
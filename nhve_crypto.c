@@ -0,0 +1,221 @@
+/*
+ * NHVE Network Hardware Video Encoder C library stream encryption implementation
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "nhve_crypto.h"
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct nhve_crypto
+{
+	EVP_CIPHER_CTX *encrypt; //key is set once, only nonce changes per frame
+	EVP_CIPHER_CTX *decrypt;
+	uint8_t nonce[NHVE_CRYPTO_NONCE_SIZE]; //next nonce for encryption
+
+	//replay protection, nonce is per channel sequence number (96 bit, big endian)
+	int received; //non-zero after the first authenticated frame
+	uint32_t last_high; //the highest authenticated nonce
+	uint64_t last_low;
+	uint64_t window; //bit i set if nonce last - i was authenticated
+};
+
+static struct nhve_crypto *nhve_crypto_close_and_return_null(struct nhve_crypto *c, const char *msg);
+static int NHVE_CRYPTO_ERROR_MSG(const char *msg);
+static int nhve_crypto_replay_check(const struct nhve_crypto *c, const uint8_t *nonce, uint64_t *distance);
+static void nhve_crypto_replay_update(struct nhve_crypto *c, const uint8_t *nonce, int ahead, uint64_t distance);
+
+struct nhve_crypto *nhve_crypto_init(int cipher, const uint8_t *key)
+{
+	struct nhve_crypto *c, zero_crypto = {0};
+	const EVP_CIPHER *evp_cipher;
+
+	if(cipher == NHVE_CRYPTO_AES_256_GCM)
+		evp_cipher = EVP_aes_256_gcm();
+	else if(cipher == NHVE_CRYPTO_CHACHA20_POLY1305)
+		evp_cipher = EVP_chacha20_poly1305();
+	else
+		return nhve_crypto_close_and_return_null(NULL, "unknown cipher");
+
+	if(key == NULL)
+		return nhve_crypto_close_and_return_null(NULL, "missing pre-shared key");
+
+	if( (c = (struct nhve_crypto*)malloc(sizeof(struct nhve_crypto))) == NULL )
+		return nhve_crypto_close_and_return_null(NULL, "not enough memory for encryption");
+
+	*c = zero_crypto;
+
+	if( (c->encrypt = EVP_CIPHER_CTX_new()) == NULL || (c->decrypt = EVP_CIPHER_CTX_new()) == NULL )
+		return nhve_crypto_close_and_return_null(c, "failed to create cipher context");
+
+	if( EVP_EncryptInit_ex(c->encrypt, evp_cipher, NULL, key, NULL) != 1 ||
+	    EVP_DecryptInit_ex(c->decrypt, evp_cipher, NULL, key, NULL) != 1 )
+		return nhve_crypto_close_and_return_null(c, "failed to initialize cipher");
+
+	//random start, incremented per frame, unique across restarts with the same key
+	if( RAND_bytes(c->nonce, sizeof(c->nonce)) != 1 )
+		return nhve_crypto_close_and_return_null(c, "failed to generate random nonce");
+
+	return c;
+}
+
+static struct nhve_crypto *nhve_crypto_close_and_return_null(struct nhve_crypto *c, const char *msg)
+{
+	if(msg)
+		fprintf(stderr, "nhve_crypto: %s\n", msg);
+
+	nhve_crypto_close(c);
+
+	return NULL;
+}
+
+void nhve_crypto_close(struct nhve_crypto *c)
+{
+	if(c == NULL)
+		return;
+
+	//contexts clear key schedules when freed
+	EVP_CIPHER_CTX_free(c->encrypt);
+	EVP_CIPHER_CTX_free(c->decrypt);
+	OPENSSL_cleanse(c, sizeof(struct nhve_crypto));
+	free(c);
+}
+
+static void nhve_crypto_nonce_increment(uint8_t *nonce)
+{
+	for(int i=NHVE_CRYPTO_NONCE_SIZE-1;i>=0 && ++nonce[i] == 0;--i)
+		;
+}
+
+int nhve_crypto_encrypt(struct nhve_crypto *c, const uint8_t *data, int size, uint8_t *encrypted, uint8_t subframe)
+{
+	uint8_t *ciphertext = encrypted + NHVE_CRYPTO_NONCE_SIZE;
+	int length, final_length;
+
+	memcpy(encrypted, c->nonce, NHVE_CRYPTO_NONCE_SIZE);
+	nhve_crypto_nonce_increment(c->nonce);
+
+	if( EVP_EncryptInit_ex(c->encrypt, NULL, NULL, NULL, encrypted) != 1 ||
+	    EVP_EncryptUpdate(c->encrypt, NULL, &length, &subframe, sizeof(subframe)) != 1 ||
+	    EVP_EncryptUpdate(c->encrypt, ciphertext, &length, data, size) != 1 ||
+	    EVP_EncryptFinal_ex(c->encrypt, ciphertext + length, &final_length) != 1 ||
+	    EVP_CIPHER_CTX_ctrl(c->encrypt, EVP_CTRL_AEAD_GET_TAG, NHVE_CRYPTO_TAG_SIZE, ciphertext + size) != 1 )
+		return NHVE_CRYPTO_ERROR_MSG("failed to encrypt frame");
+
+	return size + NHVE_CRYPTO_OVERHEAD;
+}
+
+//errors are not printed, anyone able to send packets could flood the log
+int nhve_crypto_decrypt(struct nhve_crypto *c, const uint8_t *encrypted, int size, uint8_t *data, uint8_t subframe)
+{
+	const uint8_t *ciphertext = encrypted + NHVE_CRYPTO_NONCE_SIZE;
+	const int data_size = size - NHVE_CRYPTO_OVERHEAD;
+	int length, final_length, ahead;
+	uint64_t distance;
+
+	if(data_size < 0)
+		return NHVE_CRYPTO_ERROR;
+
+	//reject replayed and too old frames before spending time on them
+	if( (ahead = nhve_crypto_replay_check(c, encrypted, &distance)) < 0 )
+		return NHVE_CRYPTO_REPLAYED;
+
+	//tag is not modified, OpenSSL API takes non-const pointer
+	if( EVP_DecryptInit_ex(c->decrypt, NULL, NULL, NULL, encrypted) != 1 ||
+	    EVP_DecryptUpdate(c->decrypt, NULL, &length, &subframe, sizeof(subframe)) != 1 ||
+	    EVP_DecryptUpdate(c->decrypt, data, &length, ciphertext, data_size) != 1 ||
+	    EVP_CIPHER_CTX_ctrl(c->decrypt, EVP_CTRL_AEAD_SET_TAG, NHVE_CRYPTO_TAG_SIZE, (void*)(ciphertext + data_size)) != 1 )
+		return NHVE_CRYPTO_ERROR;
+
+	if( EVP_DecryptFinal_ex(c->decrypt, data + length, &final_length) != 1 )
+	{
+		//don't leave unauthenticated plaintext in output
+		OPENSSL_cleanse(data, data_size);
+		return NHVE_CRYPTO_ERROR;
+	}
+
+	//only authenticated nonces move the window
+	nhve_crypto_replay_update(c, encrypted, ahead, distance);
+
+	return data_size;
+}
+
+static void nhve_crypto_nonce_read(const uint8_t *nonce, uint32_t *high, uint64_t *low)
+{
+	*high = 0;
+	*low = 0;
+
+	for(int i=0;i<4;++i)
+		*high = *high << 8 | nonce[i];
+
+	for(int i=4;i<NHVE_CRYPTO_NONCE_SIZE;++i)
+		*low = *low << 8 | nonce[i];
+}
+
+//returns 1 if nonce is ahead of the last one, 0 if inside the window and not seen yet, -1 if rejected
+//distance is set to nonce - last (ahead) or last - nonce (inside the window), saturated at window size
+static int nhve_crypto_replay_check(const struct nhve_crypto *c, const uint8_t *nonce, uint64_t *distance)
+{
+	uint32_t high;
+	uint64_t low;
+
+	*distance = NHVE_CRYPTO_REPLAY_WINDOW;
+
+	if(!c->received)
+		return 1;
+
+	nhve_crypto_nonce_read(nonce, &high, &low);
+
+	//96 bit nonce - last, modulo 2^96
+	const uint64_t ahead_low = low - c->last_low;
+	const uint32_t ahead_high = high - c->last_high - (low < c->last_low);
+
+	//less than half of nonce space ahead is newer, sender increments nonce by 1 per frame
+	if( (ahead_low | ahead_high) && ahead_high < 0x80000000u )
+	{
+		if(!ahead_high && ahead_low < NHVE_CRYPTO_REPLAY_WINDOW)
+			*distance = ahead_low;
+		return 1;
+	}
+
+	const uint64_t behind_low = c->last_low - low;
+	const uint32_t behind_high = c->last_high - high - (c->last_low < low);
+
+	if(behind_high || behind_low >= NHVE_CRYPTO_REPLAY_WINDOW || (c->window >> behind_low & 1))
+		return -1;
+
+	*distance = behind_low;
+
+	return 0;
+}
+
+static void nhve_crypto_replay_update(struct nhve_crypto *c, const uint8_t *nonce, int ahead, uint64_t distance)
+{
+	if(!ahead)
+	{
+		c->window |= (uint64_t)1 << distance;
+		return;
+	}
+
+	nhve_crypto_nonce_read(nonce, &c->last_high, &c->last_low);
+	c->window = (distance < NHVE_CRYPTO_REPLAY_WINDOW ? c->window << distance : 0) | 1;
+	c->received = 1;
+}
+
+static int NHVE_CRYPTO_ERROR_MSG(const char *msg)
+{
+	fprintf(stderr, "nhve_crypto: %s\n", msg);
+	return -1;
+}
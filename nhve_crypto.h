@@ -0,0 +1,141 @@
+/*
+ * NHVE Network Hardware Video Encoder C library stream encryption header
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef NHVE_CRYPTO_H
+#define NHVE_CRYPTO_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file nhve_crypto.h
+ * @brief Authenticated encryption of frames with pre-shared key.
+ *
+ * Available when library is built with NHVE_ENCRYPTION (OpenSSL).
+ *
+ * Every frame is encrypted separately, encrypted frame is
+ * 12 byte nonce, ciphertext of the same size as data and 16 byte tag.
+ * Subframe (channel) number is authenticated so frames can't be moved between channels.
+ *
+ * Nonce starts at random value and is incremented for every frame.
+ * OpenSSL picks AES-NI/VAES and AVX2 implementations at runtime.
+ *
+ * Receiver treats nonce as per channel sequence number.
+ * Frames with nonce already seen or older than NHVE_CRYPTO_REPLAY_WINDOW frames
+ * behind the newest authenticated one are rejected (replay protection)
+ * while limited reordering of UDP datagrams is still accepted.
+ * Use separate decryption context per channel. The first frame received
+ * by a new context is accepted, after sender restart (new random nonce)
+ * receiver has to create new context.
+ */
+
+/**
+ * @struct nhve_crypto
+ * @brief Internal encryption context (single channel, single thread).
+ *
+ * @see nhve_crypto_init
+ */
+struct nhve_crypto;
+
+/**
+ * @brief Ciphers
+ */
+enum nhve_crypto_cipher_enum
+{
+	NHVE_CRYPTO_NONE=0, //!< no encryption
+	NHVE_CRYPTO_AES_256_GCM=1, //!< AES-256-GCM, the fastest with AES-NI
+	NHVE_CRYPTO_CHACHA20_POLY1305=2, //!< ChaCha20-Poly1305, the fastest without AES-NI
+};
+
+/**
+ * @brief Encryption constants
+ */
+enum nhve_crypto_constants_enum
+{
+	NHVE_CRYPTO_KEY_SIZE=32, //!< pre-shared key size in bytes
+	NHVE_CRYPTO_NONCE_SIZE=12, //!< nonce size in bytes
+	NHVE_CRYPTO_TAG_SIZE=16, //!< authentication tag size in bytes
+	NHVE_CRYPTO_OVERHEAD=NHVE_CRYPTO_NONCE_SIZE + NHVE_CRYPTO_TAG_SIZE, //!< encrypted size - data size
+	NHVE_CRYPTO_REPLAY_WINDOW=64, //!< number of recent frames accepted out of order
+};
+
+/**
+ * @brief Decryption errors
+ */
+enum nhve_crypto_error_enum
+{
+	NHVE_CRYPTO_ERROR=-1, //!< malformed frame, wrong key or subframe or data modified
+	NHVE_CRYPTO_REPLAYED=-2, //!< frame already received or too old
+};
+
+/**
+ * @brief Initialize encryption context
+ *
+ * The same context type is used for encryption and decryption.
+ * Receiver needs one context per channel (replay protection state).
+ *
+ * @param cipher one of nhve_crypto_cipher_enum (not NHVE_CRYPTO_NONE)
+ * @param key pre-shared key of NHVE_CRYPTO_KEY_SIZE bytes
+ * @return
+ * - pointer to internal data
+ * - NULL on error, errors printed to stderr
+ */
+struct nhve_crypto *nhve_crypto_init(int cipher, const uint8_t *key);
+
+/**
+ * @brief Free encryption context
+ *
+ * Key material is cleared.
+ *
+ * @param c pointer to internal data
+ */
+void nhve_crypto_close(struct nhve_crypto *c);
+
+/**
+ * @brief Encrypt frame
+ *
+ * @param c pointer to internal data
+ * @param data frame data
+ * @param size frame data size
+ * @param encrypted output buffer of at least size + NHVE_CRYPTO_OVERHEAD bytes
+ * @param subframe subframe (channel), authenticated
+ * @return
+ * - size of encrypted frame
+ * - negative on error
+ */
+int nhve_crypto_encrypt(struct nhve_crypto *c, const uint8_t *data, int size, uint8_t *encrypted, uint8_t subframe);
+
+/**
+ * @brief Decrypt and authenticate frame
+ *
+ * Replayed frames are rejected. Errors are not printed,
+ * those are expected with hostile or faulty network.
+ *
+ * @param c pointer to internal data
+ * @param encrypted encrypted frame
+ * @param size encrypted frame size
+ * @param data output buffer of at least size - NHVE_CRYPTO_OVERHEAD bytes
+ * @param subframe subframe (channel) frame was received on
+ * @return
+ * - size of decrypted data
+ * - NHVE_CRYPTO_REPLAYED if frame was already received or is too old
+ * - NHVE_CRYPTO_ERROR on other errors (wrong key, subframe or data modified)
+ */
+int nhve_crypto_decrypt(struct nhve_crypto *c, const uint8_t *encrypted, int size, uint8_t *data, uint8_t subframe);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
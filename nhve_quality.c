@@ -0,0 +1,665 @@
+/*
+ * NHVE Network Hardware Video Encoder C library quality monitor implementation
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "nhve_quality.h"
+
+#include <libavutil/pixdesc.h>
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define NHVE_QUALITY_X86_64
+#endif
+
+enum NHVE_QUALITY_COMPILE_TIME_CONSTANTS
+{
+	NHVE_QUALITY_QUEUE=16, //!< max jobs waiting for worker
+	NHVE_QUALITY_PENDING=4, //!< max source samples waiting for decoded frame
+	NHVE_QUALITY_MAX_DEPTH=10, //!< max supported luma bit depth (SIMD kernels use 16 bit products)
+	NHVE_QUALITY_PSNR_IDENTICAL=100, //!< PSNR reported for identical frames
+};
+
+enum nhve_quality_job_type
+{
+	NHVE_QUALITY_PACKET,
+	NHVE_QUALITY_SAMPLE,
+};
+
+struct nhve_quality_job
+{
+	int type;
+	int64_t ordinal; //packet or source frame number since (re)start
+	int keyframe;
+	uint8_t *data;
+	int size;
+	int capacity;
+};
+
+//sums of 4x4 block, SSIM is computed over 8x8 windows of 2x2 blocks with step 4
+struct nhve_quality_ssim_sums
+{
+	int32_t s1; //sum of a
+	int32_t s2; //sum of b
+	int32_t ss; //sum of a*a + b*b
+	int32_t s12; //sum of a*b
+};
+
+struct nhve_quality
+{
+	int width;
+	int height;
+	int interval;
+	AVComponentDescriptor luma; //source luma layout
+	int depth;
+
+	//sending side, single thread (the channel thread)
+	int64_t frames; //source frames passed to encoder since (re)start
+	int64_t packets; //packets since (re)start
+	int resync; //packet was dropped, skip until keyframe
+
+	//shared, guarded by mutex
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int sync_initialized;
+	struct nhve_quality_job queue[NHVE_QUALITY_QUEUE];
+	int head;
+	int jobs;
+	int reset;
+	int stop;
+	struct nhve_quality_stats stats;
+	double psnr_sum;
+	double ssim_sum;
+
+	//worker side
+	pthread_t thread;
+	int thread_started;
+	AVCodecContext *decoder;
+	AVPacket *packet;
+	AVFrame *frame;
+	struct nhve_quality_job current;
+	struct nhve_quality_job pending[NHVE_QUALITY_PENDING];
+	int pending_size;
+	uint16_t *source_luma; //normalized to 16 bit values
+	uint16_t *decoded_luma;
+	struct nhve_quality_ssim_sums *ssim_sums[2]; //two rows of blocks
+	uint64_t (*sse)(const uint16_t *a, const uint16_t *b, int width);
+	void (*ssim_row)(const uint16_t *a, const uint16_t *b, int stride, int blocks, struct nhve_quality_ssim_sums *sums);
+};
+
+static void *nhve_quality_thread(void *quality);
+static struct nhve_quality *nhve_quality_close_and_return_null(struct nhve_quality *q, const char *msg);
+static int NHVE_QUALITY_ERROR_MSG(const char *msg);
+
+static uint64_t nhve_quality_sse_scalar(const uint16_t *a, const uint16_t *b, int width)
+{
+	uint64_t sse = 0;
+
+	for(int i=0;i<width;++i)
+	{
+		const int d = a[i] - b[i];
+		sse += d * d;
+	}
+
+	return sse;
+}
+
+static void nhve_quality_ssim_block(const uint16_t *a, const uint16_t *b, int stride, struct nhve_quality_ssim_sums *s)
+{
+	struct nhve_quality_ssim_sums zero_sums = {0};
+
+	*s = zero_sums;
+
+	for(int r=0;r<4;++r)
+		for(int c=0;c<4;++c)
+		{
+			const int va = a[r*stride + c], vb = b[r*stride + c];
+
+			s->s1 += va;
+			s->s2 += vb;
+			s->ss += va * va + vb * vb;
+			s->s12 += va * vb;
+		}
+}
+
+static void nhve_quality_ssim_row_scalar(const uint16_t *a, const uint16_t *b, int stride, int blocks, struct nhve_quality_ssim_sums *sums)
+{
+	for(int x=0;x<blocks;++x)
+		nhve_quality_ssim_block(a + 4*x, b + 4*x, stride, sums + x);
+}
+
+#ifdef NHVE_QUALITY_X86_64
+
+__attribute__((target("avx2")))
+static uint64_t nhve_quality_sse_avx2(const uint16_t *a, const uint16_t *b, int width)
+{
+	__m256i sum = _mm256_setzero_si256();
+	int i = 0;
+
+	//differences fit in 16 bits, squares of pairs in 32 bits for depth <= 10
+	for(;i + 16 <= width;i += 16)
+	{
+		const __m256i d = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+		const __m256i squares = _mm256_madd_epi16(d, d);
+
+		sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(squares)));
+		sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(squares, 1)));
+	}
+
+	__m128i s = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+
+	return (uint64_t)_mm_cvtsi128_si64(s) + nhve_quality_sse_scalar(a + i, b + i, width - i);
+}
+
+//4 blocks (16 pixels) per iteration, sums are transposed to nhve_quality_ssim_sums layout
+__attribute__((target("avx2")))
+static void nhve_quality_ssim_row_avx2(const uint16_t *a, const uint16_t *b, int stride, int blocks, struct nhve_quality_ssim_sums *sums)
+{
+	const __m256i ones = _mm256_set1_epi16(1);
+	int x = 0;
+
+	for(;x + 4 <= blocks;x += 4)
+	{
+		__m256i s1 = _mm256_setzero_si256(), s2 = s1, ss = s1, s12 = s1;
+
+		for(int r=0;r<4;++r)
+		{
+			const __m256i va = _mm256_loadu_si256((const __m256i*)(a + r*stride + 4*x));
+			const __m256i vb = _mm256_loadu_si256((const __m256i*)(b + r*stride + 4*x));
+
+			s1 = _mm256_add_epi16(s1, va);
+			s2 = _mm256_add_epi16(s2, vb);
+			ss = _mm256_add_epi32(ss, _mm256_add_epi32(_mm256_madd_epi16(va, va), _mm256_madd_epi16(vb, vb)));
+			s12 = _mm256_add_epi32(s12, _mm256_madd_epi16(va, vb));
+		}
+
+		//pairs of pixels to blocks, per 128 bit lane [s1 b0, s1 b1, s2 b0, s2 b1] and [ss b0, ss b1, s12 b0, s12 b1]
+		const __m256i pixel_sums = _mm256_hadd_epi32(_mm256_madd_epi16(s1, ones), _mm256_madd_epi16(s2, ones));
+		const __m256i products = _mm256_hadd_epi32(ss, s12);
+
+		const __m256i low = _mm256_unpacklo_epi32(pixel_sums, products);
+		const __m256i high = _mm256_unpackhi_epi32(pixel_sums, products);
+		const __m256i blocks02 = _mm256_unpacklo_epi32(low, high);
+		const __m256i blocks13 = _mm256_unpackhi_epi32(low, high);
+
+		_mm256_storeu_si256((__m256i*)(sums + x), _mm256_permute2x128_si256(blocks02, blocks13, 0x20));
+		_mm256_storeu_si256((__m256i*)(sums + x + 2), _mm256_permute2x128_si256(blocks02, blocks13, 0x31));
+	}
+
+	nhve_quality_ssim_row_scalar(a + 4*x, b + 4*x, stride, blocks - x, sums + x);
+}
+
+#endif
+
+struct nhve_quality *nhve_quality_init(const char *encoder, const char *pixel_format, int width, int height, int interval)
+{
+	struct nhve_quality *q, zero_quality = {0};
+	const AVCodec *encoder_codec, *decoder_codec;
+	const AVPixFmtDescriptor *desc;
+
+	if(encoder == NULL || encoder[0] == '\0')
+		encoder = "h264_vaapi";
+
+	if(pixel_format == NULL || pixel_format[0] == '\0')
+		pixel_format = "nv12";
+
+	if(interval <= 0 || width < 8 || height < 8)
+		return nhve_quality_close_and_return_null(NULL, "invalid interval or frame too small");
+
+	if( (desc = av_pix_fmt_desc_get(av_get_pix_fmt(pixel_format))) == NULL )
+		return nhve_quality_close_and_return_null(NULL, "unknown pixel format");
+
+	if( (desc->flags & AV_PIX_FMT_FLAG_RGB) || desc->comp[0].plane != 0 || desc->comp[0].depth > NHVE_QUALITY_MAX_DEPTH )
+		return nhve_quality_close_and_return_null(NULL, "only YUV formats up to 10 bit are supported");
+
+	if( (encoder_codec = avcodec_find_encoder_by_name(encoder)) == NULL )
+		return nhve_quality_close_and_return_null(NULL, "unknown encoder");
+
+	if( (decoder_codec = avcodec_find_decoder(encoder_codec->id)) == NULL )
+		return nhve_quality_close_and_return_null(NULL, "no software decoder for encoder codec");
+
+	if( (q = (struct nhve_quality*)malloc(sizeof(struct nhve_quality))) == NULL )
+		return nhve_quality_close_and_return_null(NULL, "not enough memory for quality monitor");
+
+	*q = zero_quality;
+
+	q->width = width;
+	q->height = height;
+	q->interval = interval;
+	q->luma = desc->comp[0];
+	q->depth = desc->comp[0].depth;
+	q->sse = nhve_quality_sse_scalar;
+	q->ssim_row = nhve_quality_ssim_row_scalar;
+
+#ifdef NHVE_QUALITY_X86_64
+	if(__builtin_cpu_supports("avx2"))
+	{
+		q->sse = nhve_quality_sse_avx2;
+		q->ssim_row = nhve_quality_ssim_row_avx2;
+	}
+#endif
+
+	if( (q->decoder = avcodec_alloc_context3(decoder_codec)) == NULL )
+		return nhve_quality_close_and_return_null(q, "failed to allocate decoder");
+
+	//worker is the background thread, don't add more
+	q->decoder->thread_count = 1;
+
+	if(avcodec_open2(q->decoder, decoder_codec, NULL) < 0)
+		return nhve_quality_close_and_return_null(q, "failed to open decoder");
+
+	if( (q->packet = av_packet_alloc()) == NULL || (q->frame = av_frame_alloc()) == NULL )
+		return nhve_quality_close_and_return_null(q, "not enough memory for decoder packet/frame");
+
+	if( (q->source_luma = (uint16_t*)malloc(width * height * sizeof(uint16_t))) == NULL ||
+	    (q->decoded_luma = (uint16_t*)malloc(width * height * sizeof(uint16_t))) == NULL ||
+	    (q->ssim_sums[0] = (struct nhve_quality_ssim_sums*)malloc(width / 4 * sizeof(struct nhve_quality_ssim_sums))) == NULL ||
+	    (q->ssim_sums[1] = (struct nhve_quality_ssim_sums*)malloc(width / 4 * sizeof(struct nhve_quality_ssim_sums))) == NULL )
+		return nhve_quality_close_and_return_null(q, "not enough memory for quality measurement");
+
+	if(pthread_mutex_init(&q->mutex, NULL) != 0)
+		return nhve_quality_close_and_return_null(q, "failed to initialize mutex");
+
+	if(pthread_cond_init(&q->cond, NULL) != 0)
+	{
+		pthread_mutex_destroy(&q->mutex);
+		return nhve_quality_close_and_return_null(q, "failed to initialize condition variable");
+	}
+
+	q->sync_initialized = 1;
+
+	if(pthread_create(&q->thread, NULL, nhve_quality_thread, q) != 0)
+		return nhve_quality_close_and_return_null(q, "failed to start worker thread");
+
+	q->thread_started = 1;
+
+	return q;
+}
+
+static struct nhve_quality *nhve_quality_close_and_return_null(struct nhve_quality *q, const char *msg)
+{
+	if(msg)
+		fprintf(stderr, "nhve_quality: %s\n", msg);
+
+	nhve_quality_close(q);
+
+	return NULL;
+}
+
+void nhve_quality_close(struct nhve_quality *q)
+{
+	if(q == NULL)
+		return;
+
+	if(q->thread_started)
+	{
+		pthread_mutex_lock(&q->mutex);
+		q->stop = 1;
+		pthread_cond_signal(&q->cond);
+		pthread_mutex_unlock(&q->mutex);
+
+		pthread_join(q->thread, NULL);
+	}
+
+	if(q->sync_initialized)
+	{
+		pthread_cond_destroy(&q->cond);
+		pthread_mutex_destroy(&q->mutex);
+	}
+
+	for(int i=0;i<NHVE_QUALITY_QUEUE;++i)
+		free(q->queue[i].data);
+
+	for(int i=0;i<NHVE_QUALITY_PENDING;++i)
+		free(q->pending[i].data);
+
+	free(q->current.data);
+	free(q->source_luma);
+	free(q->decoded_luma);
+	free(q->ssim_sums[0]);
+	free(q->ssim_sums[1]);
+
+	av_frame_free(&q->frame);
+	av_packet_free(&q->packet);
+	avcodec_free_context(&q->decoder);
+
+	free(q);
+}
+
+static int nhve_quality_reserve(struct nhve_quality_job *job, int size)
+{
+	if(job->capacity >= size)
+		return 0;
+
+	free(job->data);
+	job->capacity = 0;
+
+	if( (job->data = (uint8_t*)malloc(size)) == NULL )
+		return NHVE_QUALITY_ERROR_MSG("not enough memory for job");
+
+	job->capacity = size;
+
+	return 0;
+}
+
+//returns job to fill or NULL if worker is behind, call with mutex locked
+static struct nhve_quality_job *nhve_quality_push(struct nhve_quality *q, int type, int64_t ordinal, int size)
+{
+	if(q->jobs == NHVE_QUALITY_QUEUE)
+		return NULL;
+
+	struct nhve_quality_job *job = q->queue + (q->head + q->jobs) % NHVE_QUALITY_QUEUE;
+
+	if(nhve_quality_reserve(job, size) != 0)
+		return NULL;
+
+	job->type = type;
+	job->ordinal = ordinal;
+	job->size = size;
+	job->keyframe = 0;
+
+	++q->jobs;
+	pthread_cond_signal(&q->cond);
+
+	return job;
+}
+
+void nhve_quality_frame(struct nhve_quality *q, uint8_t * const *data, const int *linesize)
+{
+	const int64_t ordinal = q->frames++;
+	const int row_size = q->width * q->luma.step;
+
+	if(ordinal % q->interval)
+		return;
+
+	pthread_mutex_lock(&q->mutex);
+
+	struct nhve_quality_job *job = nhve_quality_push(q, NHVE_QUALITY_SAMPLE, ordinal, row_size * q->height);
+
+	//luma only, this is the only copy of source on sending thread
+	if(job)
+		for(int r=0;r<q->height;++r)
+			memcpy(job->data + r * row_size, data[0] + r * linesize[0], row_size);
+
+	pthread_mutex_unlock(&q->mutex);
+}
+
+void nhve_quality_packet(struct nhve_quality *q, const AVPacket *packet)
+{
+	const int64_t ordinal = q->packets++;
+	const int keyframe = packet->flags & AV_PKT_FLAG_KEY;
+
+	pthread_mutex_lock(&q->mutex);
+
+	struct nhve_quality_job *job = NULL;
+
+	//after dropped packet decoding can resume only from keyframe
+	if(!q->resync || keyframe)
+		job = nhve_quality_push(q, NHVE_QUALITY_PACKET, ordinal, packet->size);
+
+	if(job)
+	{
+		memcpy(job->data, packet->data, packet->size);
+		job->keyframe = keyframe;
+		q->resync = 0;
+	}
+	else
+	{
+		++q->stats.dropped;
+		q->resync = 1;
+	}
+
+	pthread_mutex_unlock(&q->mutex);
+}
+
+void nhve_quality_reset(struct nhve_quality *q)
+{
+	q->frames = q->packets = 0;
+
+	pthread_mutex_lock(&q->mutex);
+
+	//queued jobs belong to previous encoder
+	q->jobs = 0;
+	q->reset = 1;
+	q->resync = 0;
+	pthread_cond_signal(&q->cond);
+
+	pthread_mutex_unlock(&q->mutex);
+}
+
+void nhve_quality_stats(struct nhve_quality *q, struct nhve_quality_stats *stats)
+{
+	pthread_mutex_lock(&q->mutex);
+
+	*stats = q->stats;
+
+	if(stats->frames)
+	{
+		stats->psnr_avg = q->psnr_sum / stats->frames;
+		stats->ssim_avg = q->ssim_sum / stats->frames;
+	}
+
+	pthread_mutex_unlock(&q->mutex);
+}
+
+static void nhve_quality_swap(struct nhve_quality_job *a, struct nhve_quality_job *b)
+{
+	struct nhve_quality_job temp = *a;
+	*a = *b;
+	*b = temp;
+}
+
+//luma samples to 16 bit values (without shift), e.g. p010le high bits to 10 bit value
+static void nhve_quality_normalize(const uint8_t *data, int linesize, const AVComponentDescriptor *luma, int width, int height, uint16_t *out)
+{
+	for(int r=0;r<height;++r)
+	{
+		const uint8_t *p = data + r * linesize + luma->offset;
+		uint16_t *o = out + r * width;
+
+		if(luma->depth <= 8)
+			for(int x=0;x<width;++x)
+				o[x] = p[x * luma->step];
+		else
+			for(int x=0;x<width;++x)
+				o[x] = (p[x * luma->step] | p[x * luma->step + 1] << 8) >> luma->shift;
+	}
+}
+
+static double nhve_quality_ssim_window(const struct nhve_quality_ssim_sums *s, double c1, double c2)
+{
+	const double s1 = s->s1, s2 = s->s2;
+	//64 pixels, all terms are scaled by 64 * 64
+	const double variances = s->ss * 64.0 - s1 * s1 - s2 * s2;
+	const double covariance = s->s12 * 64.0 - s1 * s2;
+
+	return (2 * s1 * s2 + c1) * (2 * covariance + c2) / ((s1 * s1 + s2 * s2 + c1) * (variances + c2));
+}
+
+static void nhve_quality_measure(struct nhve_quality *q, const struct nhve_quality_job *sample, const AVFrame *frame)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((enum AVPixelFormat)frame->format);
+	const int width = frame->width < q->width ? frame->width : q->width;
+	const int height = frame->height < q->height ? frame->height : q->height;
+	const double max = (1 << q->depth) - 1;
+	const double c1 = (0.01 * max) * (0.01 * max) * 64 * 64, c2 = (0.03 * max) * (0.03 * max) * 64 * 64;
+	const int blocks = width / 4;
+	uint64_t sse = 0;
+	double ssim = 0;
+	int windows = 0;
+
+	if(desc == NULL || desc->comp[0].depth != q->depth || width < 8 || height < 8)
+	{
+		NHVE_QUALITY_ERROR_MSG("decoded frame format doesn't match source");
+		return;
+	}
+
+	nhve_quality_normalize(sample->data, q->width * q->luma.step, &q->luma, width, height, q->source_luma);
+	nhve_quality_normalize(frame->data[0], frame->linesize[0], desc->comp, width, height, q->decoded_luma);
+
+	for(int r=0;r<height;++r)
+		sse += q->sse(q->source_luma + r * width, q->decoded_luma + r * width, width);
+
+	for(int y=0;y<height/4;++y)
+	{
+		const struct nhve_quality_ssim_sums *above = q->ssim_sums[(y - 1) & 1];
+		struct nhve_quality_ssim_sums *row = q->ssim_sums[y & 1];
+
+		q->ssim_row(q->source_luma + 4 * y * width, q->decoded_luma + 4 * y * width, width, blocks, row);
+
+		if(y == 0)
+			continue;
+
+		for(int x=0;x+1<blocks;++x, ++windows)
+		{
+			const struct nhve_quality_ssim_sums window =
+			{
+				above[x].s1 + above[x+1].s1 + row[x].s1 + row[x+1].s1,
+				above[x].s2 + above[x+1].s2 + row[x].s2 + row[x+1].s2,
+				above[x].ss + above[x+1].ss + row[x].ss + row[x+1].ss,
+				above[x].s12 + above[x+1].s12 + row[x].s12 + row[x+1].s12,
+			};
+
+			ssim += nhve_quality_ssim_window(&window, c1, c2);
+		}
+	}
+
+	const double mse = (double)sse / ((double)width * height);
+	const double psnr = mse > 0 ? 10 * log10(max * max / mse) : NHVE_QUALITY_PSNR_IDENTICAL;
+
+	ssim /= windows;
+
+	pthread_mutex_lock(&q->mutex);
+
+	struct nhve_quality_stats *stats = &q->stats;
+
+	if(!stats->frames || psnr < stats->psnr_min)
+		stats->psnr_min = psnr;
+
+	if(!stats->frames || ssim < stats->ssim_min)
+		stats->ssim_min = ssim;
+
+	stats->psnr = psnr;
+	stats->ssim = ssim;
+	++stats->frames;
+	q->psnr_sum += psnr;
+	q->ssim_sum += ssim;
+
+	pthread_mutex_unlock(&q->mutex);
+}
+
+//decoded frame pts is packet ordinal which equals source frame ordinal (no B-frames)
+static void nhve_quality_decoded(struct nhve_quality *q, const AVFrame *frame)
+{
+	const int64_t ordinal = frame->pts;
+	int i = 0;
+
+	//older samples will never be matched (their packets were dropped)
+	while(i < q->pending_size && q->pending[i].ordinal < ordinal)
+		++i;
+
+	if(i < q->pending_size && q->pending[i].ordinal == ordinal)
+		nhve_quality_measure(q, q->pending + i++, frame);
+
+	for(int j=0;j+i<q->pending_size;++j)
+		nhve_quality_swap(q->pending + j, q->pending + j + i);
+
+	q->pending_size -= i;
+}
+
+static void nhve_quality_decode(struct nhve_quality *q, const struct nhve_quality_job *job)
+{
+	q->packet->data = job->data;
+	q->packet->size = job->size;
+	q->packet->pts = q->packet->dts = job->ordinal;
+	q->packet->flags = job->keyframe ? AV_PKT_FLAG_KEY : 0;
+
+	//decoding errors are expected after dropped packets, decoder recovers on keyframe
+	if(avcodec_send_packet(q->decoder, q->packet) < 0)
+		return;
+
+	while(avcodec_receive_frame(q->decoder, q->frame) == 0)
+	{
+		nhve_quality_decoded(q, q->frame);
+		av_frame_unref(q->frame);
+	}
+}
+
+static void nhve_quality_sample(struct nhve_quality *q, struct nhve_quality_job *job)
+{
+	//the oldest sample waited too long
+	if(q->pending_size == NHVE_QUALITY_PENDING)
+	{
+		for(int i=0;i+1<q->pending_size;++i)
+			nhve_quality_swap(q->pending + i, q->pending + i + 1);
+
+		--q->pending_size;
+	}
+
+	nhve_quality_swap(q->pending + q->pending_size++, job);
+}
+
+static void *nhve_quality_thread(void *quality)
+{
+	struct nhve_quality *q = (struct nhve_quality*)quality;
+
+	pthread_mutex_lock(&q->mutex);
+
+	while(!q->stop)
+	{
+		if(q->reset)
+		{
+			q->reset = 0;
+			pthread_mutex_unlock(&q->mutex);
+
+			avcodec_flush_buffers(q->decoder);
+			q->pending_size = 0;
+
+			pthread_mutex_lock(&q->mutex);
+			continue;
+		}
+
+		if(!q->jobs)
+		{
+			pthread_cond_wait(&q->cond, &q->mutex);
+			continue;
+		}
+
+		//take job buffer, give back the previous one for reuse
+		nhve_quality_swap(&q->current, q->queue + q->head);
+		q->head = (q->head + 1) % NHVE_QUALITY_QUEUE;
+		--q->jobs;
+
+		pthread_mutex_unlock(&q->mutex);
+
+		if(q->current.type == NHVE_QUALITY_PACKET)
+			nhve_quality_decode(q, &q->current);
+		else
+			nhve_quality_sample(q, &q->current);
+
+		pthread_mutex_lock(&q->mutex);
+	}
+
+	pthread_mutex_unlock(&q->mutex);
+
+	return NULL;
+}
+
+static int NHVE_QUALITY_ERROR_MSG(const char *msg)
+{
+	fprintf(stderr, "nhve_quality: %s\n", msg);
+	return -1;
+}
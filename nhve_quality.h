@@ -0,0 +1,117 @@
+/*
+ * NHVE Network Hardware Video Encoder C library quality monitor header
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef NHVE_QUALITY_H
+#define NHVE_QUALITY_H
+
+#include <libavcodec/avcodec.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file nhve_quality.h
+ * @brief Background quality monitor of single video channel (internal).
+ *
+ * Encoded packets are copied to worker thread and decoded with software decoder.
+ * Every interval frame luma of the source is copied and compared
+ * with decoded luma (PSNR and SSIM with SIMD kernels).
+ *
+ * Sending thread never waits for worker, when worker is behind
+ * packets are dropped and decoding resumes from the next keyframe.
+ *
+ * Used internally with quality_interval in nhve_hw_config.
+ */
+
+struct nhve_quality;
+
+/**
+ * @struct nhve_quality_stats
+ * @brief Measured quality of luma.
+ */
+struct nhve_quality_stats
+{
+	uint64_t frames; //!< number of measured frames
+	uint64_t dropped; //!< number of packets dropped because worker was behind
+	double psnr; //!< PSNR of the last measured frame in dB
+	double psnr_min; //!< min PSNR in dB
+	double psnr_avg; //!< average PSNR in dB
+	double ssim; //!< SSIM of the last measured frame
+	double ssim_min; //!< min SSIM
+	double ssim_avg; //!< average SSIM
+};
+
+/**
+ * @brief Start quality monitor
+ *
+ * Max B-frames must be 0, packets are matched with source frames in order.
+ *
+ * @param encoder FFmpeg encoder name, e.g. "h264_vaapi" (decoder is chosen for its codec)
+ * @param pixel_format source pixel format with luma in the first plane, e.g. "nv12", "p010le"
+ * @param width frame width
+ * @param height frame height
+ * @param interval measure every interval frame
+ * @return
+ * - pointer to internal data
+ * - NULL on error, errors printed to stderr
+ */
+struct nhve_quality *nhve_quality_init(const char *encoder, const char *pixel_format, int width, int height, int interval);
+
+/**
+ * @brief Stop quality monitor and free resources
+ *
+ * @param q pointer to internal data
+ */
+void nhve_quality_close(struct nhve_quality *q);
+
+/**
+ * @brief Notify about source frame passed to encoder
+ *
+ * Luma of every interval frame is copied for comparison.
+ *
+ * @param q pointer to internal data
+ * @param data source data planes
+ * @param linesize source strides
+ */
+void nhve_quality_frame(struct nhve_quality *q, uint8_t * const *data, const int *linesize);
+
+/**
+ * @brief Pass copy of encoded packet to decoder
+ *
+ * @param q pointer to internal data
+ * @param packet encoded packet
+ */
+void nhve_quality_packet(struct nhve_quality *q, const AVPacket *packet);
+
+/**
+ * @brief Restart after encoder was reinitialized
+ *
+ * @param q pointer to internal data
+ */
+void nhve_quality_reset(struct nhve_quality *q);
+
+/**
+ * @brief Get measured quality
+ *
+ * May be called concurrently with other functions.
+ *
+ * @param q pointer to internal data
+ * @param stats statistics to fill
+ */
+void nhve_quality_stats(struct nhve_quality *q, struct nhve_quality_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
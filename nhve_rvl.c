@@ -0,0 +1,367 @@
+/*
+ * NHVE Network Hardware Video Encoder C library lossless depth codec implementation
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "nhve_rvl.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define NHVE_RVL_X86_64
+#endif
+
+enum NHVE_RVL_COMPILE_TIME_CONSTANTS
+{
+	NHVE_RVL_HEADER_SIZE=4, //!< little endian uint32 number of pixels
+};
+
+//nibbles are packed most significant first into 32 bit words
+//pending nibbles are kept in 64 bit accumulator so that 8 nibbles can be appended at once
+struct nhve_rvl_writer
+{
+	uint8_t *out;
+	uint64_t accumulator;
+	int bits; //pending bits in accumulator, always < 32 between calls
+};
+
+struct nhve_rvl_reader
+{
+	const uint8_t *in;
+	const uint8_t *end;
+	uint32_t word;
+	int nibbles; //nibbles left in word
+};
+
+static inline void nhve_rvl_put(struct nhve_rvl_writer *w, uint32_t value, int bits)
+{
+	w->accumulator = (w->accumulator << bits) | value;
+	w->bits += bits;
+
+	if(w->bits >= 32)
+	{
+		w->bits -= 32;
+		const uint32_t word = (uint32_t)(w->accumulator >> w->bits);
+		memcpy(w->out, &word, sizeof(word));
+		w->out += sizeof(word);
+	}
+}
+
+//variable length encoding, 3 bits per nibble (least significant first), the highest bit marks continuation
+static inline void nhve_rvl_put_vle(struct nhve_rvl_writer *w, uint32_t value)
+{
+	uint64_t code = 0;
+	int bits = 0;
+
+	if(value < 8)
+	{
+		nhve_rvl_put(w, value, 4);
+		return;
+	}
+
+	do
+	{
+		uint32_t nibble = value & 7;
+
+		if( (value >>= 3) )
+			nibble |= 8;
+
+		code = (code << 4) | nibble;
+		bits += 4;
+	}
+	while(value);
+
+	if(bits > 32)
+	{
+		nhve_rvl_put(w, (uint32_t)(code >> 32), bits - 32);
+		bits = 32;
+	}
+
+	nhve_rvl_put(w, (uint32_t)code, bits);
+}
+
+static inline void nhve_rvl_put_delta(struct nhve_rvl_writer *w, int current, int *previous)
+{
+	const int delta = current - *previous;
+
+	//zigzag, small negative and positive deltas as small positive values
+	nhve_rvl_put_vle(w, ((uint32_t)delta << 1) ^ -(uint32_t)(delta < 0));
+	*previous = current;
+}
+
+static int nhve_rvl_flush(struct nhve_rvl_writer *w, uint8_t *encoded)
+{
+	if(w->bits)
+	{
+		const uint32_t word = (uint32_t)(w->accumulator << (32 - w->bits));
+		memcpy(w->out, &word, sizeof(word));
+		w->out += sizeof(word);
+	}
+
+	return (int)(w->out - encoded);
+}
+
+static int nhve_rvl_encode_scalar(const uint16_t *depth, int pixels, uint8_t *encoded)
+{
+	struct nhve_rvl_writer w = {encoded + NHVE_RVL_HEADER_SIZE, 0, 0};
+	const uint16_t *p = depth, *end = depth + pixels;
+	int previous = 0;
+
+	while(p < end)
+	{
+		const uint16_t *q = p;
+
+		while(q < end && !*q)
+			++q;
+
+		nhve_rvl_put_vle(&w, q - p);
+
+		for(p = q; q < end && *q; ++q)
+			;
+
+		nhve_rvl_put_vle(&w, q - p);
+
+		for(; p < q; ++p)
+			nhve_rvl_put_delta(&w, *p, &previous);
+	}
+
+	return nhve_rvl_flush(&w, encoded);
+}
+
+#ifdef NHVE_RVL_X86_64
+
+__attribute__((target("avx2,bmi")))
+static inline const uint16_t *nhve_rvl_zero_run_end_avx2(const uint16_t *p, const uint16_t *end)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	for(;p + 16 <= end; p += 16)
+	{
+		const uint32_t zeros = _mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)p), zero));
+
+		if(zeros != 0xFFFFFFFF)
+			return p + _tzcnt_u32(~zeros) / 2;
+	}
+
+	while(p < end && !*p)
+		++p;
+
+	return p;
+}
+
+__attribute__((target("avx2,bmi")))
+static inline const uint16_t *nhve_rvl_nonzero_run_end_avx2(const uint16_t *p, const uint16_t *end)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	for(;p + 16 <= end; p += 16)
+	{
+		const uint32_t zeros = _mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)p), zero));
+
+		if(zeros)
+			return p + _tzcnt_u32(zeros) / 2;
+	}
+
+	while(p < end && *p)
+		++p;
+
+	return p;
+}
+
+//variable length codes of 8 values (at most 6 nibbles each for 16 bit deltas)
+__attribute__((target("avx2,bmi")))
+static inline void nhve_rvl_put_codes_avx2(struct nhve_rvl_writer *w, __m256i value)
+{
+	const __m256i low_bits = _mm256_set1_epi32(7), continuation = _mm256_set1_epi32(8);
+	__m256i code = _mm256_setzero_si256(), nibbles = _mm256_setzero_si256(), active = _mm256_set1_epi32(-1);
+	uint32_t codes[8], lengths[8];
+
+	do
+	{
+		const __m256i next = _mm256_srli_epi32(value, 3);
+		const __m256i more = _mm256_cmpgt_epi32(next, _mm256_setzero_si256());
+		const __m256i nibble = _mm256_or_si256(_mm256_and_si256(value, low_bits), _mm256_and_si256(more, continuation));
+
+		code = _mm256_blendv_epi8(code, _mm256_or_si256(_mm256_slli_epi32(code, 4), nibble), active);
+		nibbles = _mm256_sub_epi32(nibbles, active);
+		active = _mm256_and_si256(active, more);
+		value = next;
+	}
+	while(!_mm256_testz_si256(active, active));
+
+	_mm256_storeu_si256((__m256i*)codes, code);
+	_mm256_storeu_si256((__m256i*)lengths, _mm256_slli_epi32(nibbles, 2));
+
+	for(int i=0;i<8;++i)
+		nhve_rvl_put(w, codes[i], lengths[i]);
+}
+
+//deltas of non-zero run, 8 at a time, with fast path when all fit in single nibble
+__attribute__((target("avx2,bmi")))
+static inline void nhve_rvl_put_deltas_avx2(struct nhve_rvl_writer *w, const uint16_t *p, const uint16_t *q, int *previous)
+{
+	const __m256i shifts = _mm256_setr_epi32(28, 24, 20, 16, 12, 8, 4, 0);
+	const __m256i max_single_nibble = _mm256_set1_epi32(7);
+
+	//the first delta is from the last non-zero value before zero run
+	nhve_rvl_put_delta(w, *p++, previous);
+
+	for(;p + 8 <= q; p += 8)
+	{
+		const __m256i current = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p));
+		const __m256i prev = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(p - 1)));
+		const __m256i delta = _mm256_sub_epi32(current, prev);
+		const __m256i zigzag = _mm256_xor_si256(_mm256_slli_epi32(delta, 1), _mm256_srai_epi32(delta, 31));
+
+		*previous = p[7];
+
+		if(!_mm256_testz_si256(_mm256_cmpgt_epi32(zigzag, max_single_nibble), _mm256_set1_epi32(-1)))
+		{
+			nhve_rvl_put_codes_avx2(w, zigzag);
+			continue;
+		}
+
+		//8 single nibble values, pack into 32 bits (first value in the highest nibble)
+		__m256i packed = _mm256_sllv_epi32(zigzag, shifts);
+		__m128i half = _mm_or_si128(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1));
+		half = _mm_or_si128(half, _mm_unpackhi_epi64(half, half));
+		half = _mm_or_si128(half, _mm_srli_epi64(half, 32));
+
+		nhve_rvl_put(w, (uint32_t)_mm_cvtsi128_si32(half), 32);
+	}
+
+	for(;p < q;++p)
+		nhve_rvl_put_delta(w, *p, previous);
+}
+
+__attribute__((target("avx2,bmi")))
+static int nhve_rvl_encode_avx2(const uint16_t *depth, int pixels, uint8_t *encoded)
+{
+	struct nhve_rvl_writer w = {encoded + NHVE_RVL_HEADER_SIZE, 0, 0};
+	const uint16_t *p = depth, *end = depth + pixels;
+	int previous = 0;
+
+	while(p < end)
+	{
+		const uint16_t *q = nhve_rvl_zero_run_end_avx2(p, end);
+
+		nhve_rvl_put_vle(&w, q - p);
+
+		p = q;
+		q = nhve_rvl_nonzero_run_end_avx2(p, end);
+
+		nhve_rvl_put_vle(&w, q - p);
+
+		if(p < q)
+			nhve_rvl_put_deltas_avx2(&w, p, q, &previous);
+
+		p = q;
+	}
+
+	return nhve_rvl_flush(&w, encoded);
+}
+
+#endif
+
+int nhve_rvl_encoded_size_max(int pixels)
+{
+	//per pixel at most 6 nibbles of delta and 1 nibble of run length, 2 run lengths at end, word padding
+	return NHVE_RVL_HEADER_SIZE + pixels * 4 + 8;
+}
+
+int nhve_rvl_encode(const uint16_t *depth, int pixels, uint8_t *encoded)
+{
+	const uint32_t header = pixels;
+
+	memcpy(encoded, &header, sizeof(header));
+
+#ifdef NHVE_RVL_X86_64
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi"))
+		return nhve_rvl_encode_avx2(depth, pixels, encoded);
+#endif
+
+	return nhve_rvl_encode_scalar(depth, pixels, encoded);
+}
+
+static inline int nhve_rvl_get_vle(struct nhve_rvl_reader *r, uint32_t *value)
+{
+	uint32_t nibble;
+	int shift = 0;
+
+	*value = 0;
+
+	do
+	{
+		//at most 11 nibbles (32 bit value), longer code is malformed
+		if(shift > 30)
+			return -1;
+
+		if(!r->nibbles)
+		{
+			if(r->in + sizeof(r->word) > r->end)
+				return -1;
+
+			memcpy(&r->word, r->in, sizeof(r->word));
+			r->in += sizeof(r->word);
+			r->nibbles = 8;
+		}
+
+		nibble = r->word >> 28;
+		r->word <<= 4;
+		--r->nibbles;
+
+		*value |= (nibble & 7) << shift;
+		shift += 3;
+	}
+	while(nibble & 8);
+
+	return 0;
+}
+
+int nhve_rvl_decode(const uint8_t *encoded, int size, uint16_t *depth, int pixels)
+{
+	struct nhve_rvl_reader r = {encoded + NHVE_RVL_HEADER_SIZE, encoded + size, 0, 0};
+	uint32_t header, zeros, nonzeros, zigzag;
+	uint16_t previous = 0; //wraps on malformed input instead of signed overflow
+
+	if(size < NHVE_RVL_HEADER_SIZE)
+		return -1;
+
+	memcpy(&header, encoded, sizeof(header));
+
+	if(header > (uint32_t)pixels)
+		return -1;
+
+	uint16_t *p = depth, *end = depth + header;
+
+	while(p < end)
+	{
+		if(nhve_rvl_get_vle(&r, &zeros) || zeros > (uint32_t)(end - p))
+			return -1;
+
+		memset(p, 0, zeros * sizeof(uint16_t));
+		p += zeros;
+
+		if(nhve_rvl_get_vle(&r, &nonzeros) || nonzeros > (uint32_t)(end - p))
+			return -1;
+
+		for(uint16_t *q = p + nonzeros; p < q; ++p)
+		{
+			if(nhve_rvl_get_vle(&r, &zigzag))
+				return -1;
+
+			//zigzag decoding in unsigned arithmetic, valid deltas are exact modulo 2^16
+			previous += (uint16_t)((zigzag >> 1) ^ -(zigzag & 1));
+			*p = previous;
+		}
+	}
+
+	return header;
+}
@@ -0,0 +1,69 @@
+/*
+ * NHVE Network Hardware Video Encoder C library lossless depth codec header
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef NHVE_RVL_H
+#define NHVE_RVL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file nhve_rvl.h
+ * @brief Fast lossless depth compression (RVL).
+ *
+ * Run length of zeros (invalid depth) and variable length coded
+ * zigzag deltas of non-zero depth, packed in 4 bit nibbles.
+ *
+ * See A. D. Wilson "Fast Lossless Depth Image Compression" (2017).
+ *
+ * Encoded data is little endian uint32 number of pixels followed by
+ * little endian uint32 words of nibbles (the same as original RVL).
+ */
+
+/**
+ * @brief Max size of encoded data
+ *
+ * @param pixels number of 16 bit depth pixels
+ * @return max size in bytes of encoded data
+ */
+int nhve_rvl_encoded_size_max(int pixels);
+
+/**
+ * @brief Encode depth data
+ *
+ * @param depth 16 bit depth pixels
+ * @param pixels number of depth pixels
+ * @param encoded output buffer of at least nhve_rvl_encoded_size_max(pixels) size
+ * @return size of encoded data in bytes
+ */
+int nhve_rvl_encode(const uint16_t *depth, int pixels, uint8_t *encoded);
+
+/**
+ * @brief Decode depth data
+ *
+ * @param encoded encoded data
+ * @param size encoded data size in bytes
+ * @param depth output buffer for decoded pixels
+ * @param pixels size of output buffer in pixels
+ * @return
+ * - number of decoded pixels
+ * - negative on error (corrupted data or too small output buffer)
+ */
+int nhve_rvl_decode(const uint8_t *encoded, int size, uint16_t *depth, int pixels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
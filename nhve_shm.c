@@ -0,0 +1,418 @@
+/*
+ * NHVE Network Hardware Video Encoder C library shared memory transport implementation
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "nhve_shm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h> //kill
+#include <fcntl.h> //O_CREAT, O_EXCL, O_RDWR
+#include <unistd.h> //ftruncate, close, syscall, getpid
+#include <sys/mman.h> //shm_open, mmap
+#include <sys/stat.h> //fstat
+#include <sys/syscall.h> //SYS_futex
+#include <linux/futex.h> //FUTEX_WAIT, FUTEX_WAKE
+
+enum NHVE_SHM_COMPILE_TIME_CONSTANTS
+{
+	NHVE_SHM_MAGIC=0x4E485645, //!< "NHVE"
+	NHVE_SHM_VERSION=2, //!< shared memory layout version
+	NHVE_SHM_DEFAULT_SIZE=32*1024*1024, //!< default ring buffer size
+	NHVE_SHM_DATA_OFFSET=64, //!< ring buffer data starts after header
+	NHVE_SHM_ALIGN=8, //!< records are aligned to NHVE_SHM_ALIGN
+	NHVE_SHM_PADDING=1, //!< record flag, the rest of ring is unused, continue from the beginning
+};
+
+//shared between processes, positions grow monotonically (ring offset is position % capacity)
+//writer reserves space (reserve_position), writes record, publishes it (write_position)
+//readers validate data by checking that reserve_position didn't pass it by capacity
+struct nhve_shm_header
+{
+	uint32_t magic; //written last during initialization
+	uint32_t version;
+	uint64_t capacity; //ring data size
+	uint64_t reserve_position; //writer may be writing data below this position
+	uint64_t write_position; //data below this position is published
+	uint32_t futex; //changes with every published frame
+	uint32_t waiters; //number of readers waiting on futex
+	int32_t writer_pid; //process that created segment, segment of dead writer is stale
+};
+
+struct nhve_shm_record
+{
+	uint32_t size;
+	uint16_t subframe;
+	uint16_t flags;
+	uint64_t framenumber;
+	uint64_t timestamp_us;
+};
+
+struct nhve_shm
+{
+	int fd;
+	char *name; //writer only (for shm_unlink)
+	struct nhve_shm_header *header;
+	uint8_t *ring;
+	size_t mapping_size;
+	uint64_t position; //writer - write position, reader - read position
+};
+
+static struct nhve_shm *nhve_shm_open(const char *name, int writer, int size);
+static int nhve_shm_create(const char *name);
+static int nhve_shm_unlink_stale(const char *name);
+static struct nhve_shm *nhve_shm_close_and_return_null(struct nhve_shm *s, const char *msg);
+static int NHVE_SHM_ERROR_MSG(const char *msg);
+
+static uint64_t nhve_shm_align(uint64_t size)
+{
+	return (size + NHVE_SHM_ALIGN - 1) & ~(uint64_t)(NHVE_SHM_ALIGN - 1);
+}
+
+static uint64_t nhve_shm_time_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+struct nhve_shm *nhve_shm_writer_init(const char *name, int size)
+{
+	return nhve_shm_open(name, 1, size > 0 ? size : NHVE_SHM_DEFAULT_SIZE);
+}
+
+struct nhve_shm *nhve_shm_reader_init(const char *name)
+{
+	return nhve_shm_open(name, 0, 0);
+}
+
+static struct nhve_shm *nhve_shm_open(const char *name, int writer, int size)
+{
+	struct nhve_shm *s, zero_shm = {0};
+	struct stat st;
+
+	if(sizeof(struct nhve_shm_header) > NHVE_SHM_DATA_OFFSET)
+		return nhve_shm_close_and_return_null(NULL, "shared memory header exceeds data offset");
+
+	if( (s = (struct nhve_shm*)malloc(sizeof(struct nhve_shm))) == NULL )
+		return nhve_shm_close_and_return_null(NULL, "not enough memory for shared memory data");
+
+	*s = zero_shm;
+	s->fd = -1;
+
+	if(writer && (s->fd = nhve_shm_create(name)) == -1)
+		return nhve_shm_close_and_return_null(s, errno == EEXIST ?
+			"shared memory exists and is not stale (other writer running or remove it manually)" :
+			"failed to create shared memory");
+
+	if(!writer && (s->fd = shm_open(name, O_RDWR, 0600)) == -1 )
+		return nhve_shm_close_and_return_null(s, "failed to open shared memory");
+
+	if(writer)
+	{
+		const uint64_t capacity = nhve_shm_align(size);
+
+		if( (s->name = strdup(name)) == NULL )
+			return nhve_shm_close_and_return_null(s, "not enough memory for shared memory name");
+
+		if(ftruncate(s->fd, NHVE_SHM_DATA_OFFSET + capacity) == -1)
+			return nhve_shm_close_and_return_null(s, "failed to set shared memory size");
+	}
+
+	if(fstat(s->fd, &st) == -1 || st.st_size <= NHVE_SHM_DATA_OFFSET)
+		return nhve_shm_close_and_return_null(s, "failed to get shared memory size");
+
+	s->mapping_size = st.st_size;
+
+	//readers also write (number of waiters for futex)
+	void *mapping = mmap(NULL, s->mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+
+	if(mapping == MAP_FAILED)
+		return nhve_shm_close_and_return_null(s, "failed to map shared memory");
+
+	s->header = (struct nhve_shm_header*)mapping;
+	s->ring = (uint8_t*)mapping + NHVE_SHM_DATA_OFFSET;
+
+	if(writer)
+	{
+		struct nhve_shm_header *h = s->header;
+
+		__atomic_store_n(&h->magic, 0, __ATOMIC_RELEASE);
+
+		h->version = NHVE_SHM_VERSION;
+		h->capacity = s->mapping_size - NHVE_SHM_DATA_OFFSET;
+		h->reserve_position = h->write_position = 0;
+		h->futex = h->waiters = 0;
+		h->writer_pid = getpid();
+
+		__atomic_store_n(&h->magic, NHVE_SHM_MAGIC, __ATOMIC_RELEASE);
+
+		return s;
+	}
+
+	if(__atomic_load_n(&s->header->magic, __ATOMIC_ACQUIRE) != NHVE_SHM_MAGIC)
+		return nhve_shm_close_and_return_null(s, "shared memory not initialized by writer");
+
+	if(s->header->version != NHVE_SHM_VERSION)
+		return nhve_shm_close_and_return_null(s, "shared memory layout version mismatch");
+
+	if(s->header->capacity != s->mapping_size - NHVE_SHM_DATA_OFFSET)
+		return nhve_shm_close_and_return_null(s, "shared memory size mismatch");
+
+	s->position = __atomic_load_n(&s->header->write_position, __ATOMIC_ACQUIRE);
+
+	return s;
+}
+
+//live segment of other writer is never truncated or reset, only segment of dead writer is replaced
+static int nhve_shm_create(const char *name)
+{
+	int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+
+	if(fd == -1 && errno == EEXIST)
+	{
+		if(!nhve_shm_unlink_stale(name))
+		{
+			errno = EEXIST;
+			return -1;
+		}
+
+		fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	}
+
+	return fd;
+}
+
+//unlinks initialized segment with writer process that no longer exists, returns non-zero if unlinked
+//segment without valid header (e.g. writer still initializing or other layout version) is left alone
+static int nhve_shm_unlink_stale(const char *name)
+{
+	struct nhve_shm_header *h;
+	struct stat st;
+	int fd, stale = 0;
+
+	if( (fd = shm_open(name, O_RDONLY, 0)) == -1 )
+		return errno == ENOENT; //unlinked in the meantime
+
+	if(fstat(fd, &st) == 0 && st.st_size > NHVE_SHM_DATA_OFFSET)
+		if( (h = mmap(NULL, sizeof(struct nhve_shm_header), PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED )
+		{
+			const pid_t pid = h->writer_pid;
+
+			//EPERM means process exists (owned by other user)
+			stale = __atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) == NHVE_SHM_MAGIC && h->version == NHVE_SHM_VERSION &&
+			        pid > 0 && pid != getpid() && kill(pid, 0) == -1 && errno == ESRCH;
+
+			munmap(h, sizeof(struct nhve_shm_header));
+		}
+
+	close(fd);
+
+	if(stale)
+		shm_unlink(name);
+
+	return stale;
+}
+
+static struct nhve_shm *nhve_shm_close_and_return_null(struct nhve_shm *s, const char *msg)
+{
+	if(msg)
+		fprintf(stderr, "nhve_shm: %s\n", msg);
+
+	nhve_shm_close(s);
+
+	return NULL;
+}
+
+void nhve_shm_close(struct nhve_shm *s)
+{
+	if(s == NULL)
+		return;
+
+	if(s->header)
+		munmap(s->header, s->mapping_size);
+
+	if(s->fd != -1)
+		close(s->fd);
+
+	if(s->name)
+		shm_unlink(s->name);
+
+	free(s->name);
+	free(s);
+}
+
+int nhve_shm_write(struct nhve_shm *s, const uint8_t *data, int size, uint8_t subframe, uint64_t framenumber)
+{
+	struct nhve_shm_header *h = s->header;
+	const uint64_t capacity = h->capacity;
+	const uint64_t need = nhve_shm_align(sizeof(struct nhve_shm_record) + size);
+	uint64_t position = s->position;
+	uint64_t offset = position % capacity;
+	struct nhve_shm_record record = {size, subframe, 0, framenumber, nhve_shm_time_us()};
+
+	if(need > capacity)
+		return NHVE_SHM_ERROR_MSG("frame exceeds shared memory size");
+
+	//doesn't fit at the end of ring, mark padding (if possible) and continue from the beginning
+	const uint64_t wrap = capacity - offset < need ? capacity - offset : 0;
+
+	//announce region that is going to be overwritten before touching it
+	__atomic_store_n(&h->reserve_position, position + wrap + need, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if(wrap)
+	{
+		if(wrap >= sizeof(struct nhve_shm_record))
+		{
+			struct nhve_shm_record padding = {0, 0, NHVE_SHM_PADDING, 0, 0};
+			memcpy(s->ring + offset, &padding, sizeof(padding));
+		}
+
+		position += wrap;
+		offset = 0;
+	}
+
+	memcpy(s->ring + offset, &record, sizeof(record));
+
+	if(size)
+		memcpy(s->ring + offset + sizeof(record), data, size);
+
+	s->position = position + need;
+
+	__atomic_store_n(&h->write_position, s->position, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&h->futex, 1, __ATOMIC_SEQ_CST);
+
+	if(__atomic_load_n(&h->waiters, __ATOMIC_SEQ_CST))
+		syscall(SYS_futex, &h->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+
+	return NHVE_SHM_OK;
+}
+
+//waits until something is published after reader position
+static int nhve_shm_wait(struct nhve_shm *s, int timeout_ms)
+{
+	struct nhve_shm_header *h = s->header;
+	const uint64_t deadline_us = nhve_shm_time_us() + (uint64_t)timeout_ms * 1000;
+
+	while(__atomic_load_n(&h->write_position, __ATOMIC_ACQUIRE) == s->position)
+	{
+		struct timespec timeout, *timeout_ptr = NULL;
+
+		if(timeout_ms >= 0)
+		{
+			const uint64_t now_us = nhve_shm_time_us();
+
+			if(now_us >= deadline_us)
+				return NHVE_SHM_TIMEOUT;
+
+			timeout.tv_sec = (deadline_us - now_us) / 1000000;
+			timeout.tv_nsec = (deadline_us - now_us) % 1000000 * 1000;
+			timeout_ptr = &timeout;
+		}
+
+		//register as waiter before checking position for the last time (no lost wakeups)
+		__atomic_add_fetch(&h->waiters, 1, __ATOMIC_SEQ_CST);
+
+		const uint32_t futex = __atomic_load_n(&h->futex, __ATOMIC_SEQ_CST);
+		int status = 0;
+
+		if(__atomic_load_n(&h->write_position, __ATOMIC_SEQ_CST) == s->position)
+			status = syscall(SYS_futex, &h->futex, FUTEX_WAIT, futex, timeout_ptr, NULL, 0);
+
+		__atomic_sub_fetch(&h->waiters, 1, __ATOMIC_SEQ_CST);
+
+		if(status == -1 && errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT)
+			return NHVE_SHM_ERROR_MSG("failed to wait for shared memory data");
+	}
+
+	return NHVE_SHM_OK;
+}
+
+int nhve_shm_read(struct nhve_shm *s, struct nhve_shm_frame *frame, int timeout_ms)
+{
+	const uint64_t capacity = s->header->capacity;
+	struct nhve_shm_record record;
+	int status;
+
+	while(1)
+	{
+		if( (status = nhve_shm_wait(s, timeout_ms)) != NHVE_SHM_OK )
+			return status;
+
+		const uint64_t write_position = __atomic_load_n(&s->header->write_position, __ATOMIC_ACQUIRE);
+		const uint64_t offset = s->position % capacity;
+
+		if(write_position - s->position > capacity)
+		{
+			s->position = write_position;
+			return NHVE_SHM_OVERRUN;
+		}
+
+		//no room for record at the end of ring, writer continued from the beginning
+		if(capacity - offset < sizeof(record))
+		{
+			s->position += capacity - offset;
+			continue;
+		}
+
+		memcpy(&record, s->ring + offset, sizeof(record));
+
+		frame->position = s->position;
+
+		//record header may have been overwritten while copying
+		if(!nhve_shm_valid(s, frame))
+		{
+			s->position = write_position;
+			return NHVE_SHM_OVERRUN;
+		}
+
+		if(record.flags & NHVE_SHM_PADDING)
+		{
+			s->position += capacity - offset;
+			continue;
+		}
+
+		if(record.size > capacity - offset - sizeof(record))
+			return NHVE_SHM_ERROR_MSG("corrupted shared memory record");
+
+		break;
+	}
+
+	frame->data = record.size ? s->ring + s->position % capacity + sizeof(record) : NULL;
+	frame->size = record.size;
+	frame->subframe = record.subframe;
+	frame->framenumber = record.framenumber;
+	frame->timestamp_us = record.timestamp_us;
+
+	s->position += nhve_shm_align(sizeof(record) + record.size);
+
+	return NHVE_SHM_OK;
+}
+
+int nhve_shm_valid(const struct nhve_shm *s, const struct nhve_shm_frame *frame)
+{
+	//order reads of frame data before reading writer reservation
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	const uint64_t reserve_position = __atomic_load_n(&s->header->reserve_position, __ATOMIC_RELAXED);
+
+	return reserve_position - frame->position <= s->header->capacity;
+}
+
+static int NHVE_SHM_ERROR_MSG(const char *msg)
+{
+	fprintf(stderr, "nhve_shm: %s\n", msg);
+	return NHVE_SHM_ERROR;
+}
@@ -0,0 +1,151 @@
+/*
+ * NHVE Network Hardware Video Encoder C library shared memory transport header
+ *
+ * Copyright 2019-2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef NHVE_SHM_H
+#define NHVE_SHM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @struct nhve_shm
+ * @brief Internal shared memory ring buffer data (writer or reader).
+ *
+ * Writer publishes frames (encoded video or auxiliary data) in POSIX shared memory ring buffer.
+ * Any number of readers on the same host consumes frames directly from shared memory.
+ * Readers don't block the writer, slow reader may be overrun and loses frames.
+ *
+ * @see nhve_shm_writer_init, nhve_shm_reader_init
+ */
+struct nhve_shm;
+
+/**
+ * @struct nhve_shm_frame
+ * @brief Frame read from shared memory.
+ *
+ * Data points directly to shared memory (no copying).
+ * It is valid until overwritten by writer, see nhve_shm_valid.
+ *
+ * @see nhve_shm_read
+ */
+struct nhve_shm_frame
+{
+	const uint8_t *data; //!< frame data in shared memory (NULL for empty frame)
+	int size; //!< frame data size
+	uint8_t subframe; //!< subframe (channel) as defined by nhve_init hw_size and aux_size
+	uint64_t framenumber; //!< frameset number
+	uint64_t timestamp_us; //!< CLOCK_MONOTONIC publish time in microseconds
+	uint64_t position; //!< ring position (internal, used by nhve_shm_valid)
+};
+
+/**
+  * @brief Constants returned by shared memory functions
+  */
+enum nhve_shm_retval_enum
+{
+	NHVE_SHM_OVERRUN=-3, //!< reader was overrun by writer, frames were lost
+	NHVE_SHM_TIMEOUT=-2, //!< no data within timeout
+	NHVE_SHM_ERROR=-1, //!< error occured
+	NHVE_SHM_OK=0, //!< succesfull execution
+};
+
+/**
+ * @brief Create shared memory ring buffer for writing
+ *
+ * Used internally by nhve_init with shm_name in nhve_net_config.
+ *
+ * Shared memory is created exclusively and removed by nhve_shm_close.
+ * Existing segment is replaced only if its writer process no longer exists (e.g. crashed),
+ * otherwise (e.g. other writer running with the same name) this function fails.
+ *
+ * @param name POSIX shared memory name, e.g. "/nhve"
+ * @param size ring buffer size in bytes, 0 for default
+ * @return
+ * - pointer to internal data
+ * - NULL on error, errors printed to stderr
+ */
+struct nhve_shm *nhve_shm_writer_init(const char *name, int size);
+
+/**
+ * @brief Publish frame in shared memory ring buffer
+ *
+ * Data is copied once, to shared memory. Waiting readers are woken up.
+ *
+ * @param s pointer to internal data
+ * @param data frame data (may be NULL for empty frame)
+ * @param size frame data size
+ * @param subframe subframe (channel)
+ * @param framenumber frameset number
+ * @return
+ * - NHVE_SHM_OK on success
+ * - NHVE_SHM_ERROR on error
+ */
+int nhve_shm_write(struct nhve_shm *s, const uint8_t *data, int size, uint8_t subframe, uint64_t framenumber);
+
+/**
+ * @brief Open existing shared memory ring buffer for reading
+ *
+ * Reader starts with the next published frame.
+ *
+ * @param name POSIX shared memory name, e.g. "/nhve"
+ * @return
+ * - pointer to internal data
+ * - NULL on error, errors printed to stderr
+ */
+struct nhve_shm *nhve_shm_reader_init(const char *name);
+
+/**
+ * @brief Read next frame
+ *
+ * Function blocks until frame is published, timeout or error occurs.
+ *
+ * Frame data is not copied, it points to shared memory.
+ * Check nhve_shm_valid after processing data to see if writer didn't overwrite it.
+ *
+ * @param s pointer to internal data
+ * @param frame frame to fill
+ * @param timeout_ms maximum time to wait, negative for infinite
+ * @return
+ * - NHVE_SHM_OK on success
+ * - NHVE_SHM_TIMEOUT on timeout
+ * - NHVE_SHM_OVERRUN if reader was overrun (skips to the newest data, call again)
+ * - NHVE_SHM_ERROR on error
+ */
+int nhve_shm_read(struct nhve_shm *s, struct nhve_shm_frame *frame, int timeout_ms);
+
+/**
+ * @brief Check if frame data is still valid
+ *
+ * @param s pointer to internal data
+ * @param frame frame returned by nhve_shm_read
+ * @return
+ * - non zero if data was not overwritten by writer
+ * - zero otherwise
+ */
+int nhve_shm_valid(const struct nhve_shm *s, const struct nhve_shm_frame *frame);
+
+/**
+ * @brief Free resources
+ *
+ * Writer also removes shared memory name.
+ *
+ * @param s pointer to internal data
+ */
+void nhve_shm_close(struct nhve_shm *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif